@@ -0,0 +1,142 @@
+#include <catch2/catch.hpp>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "environment.hpp"
+#include "interpreter.hpp"
+#include "loop_optimizer.hpp"
+#include "output.hpp"
+#include "parser.hpp"
+#include "pass_manager.hpp"
+#include "resolver.hpp"
+#include "scanner.hpp"
+#include "source_buffer.hpp"
+#include "type_inference.hpp"
+
+namespace lox
+{
+namespace
+{
+const std::vector<std::string> Corpus{"numeric_loops", "deep_scopes", "string_building",
+                                      "print_heavy"};
+
+std::shared_ptr<const SourceBuffer> load(const std::string& name)
+{
+    return SourceBuffer::fromFile(std::string(LOX_BENCH_CORPUS) + "/" + name + ".lox");
+}
+
+// Runs everything Application does before handing a program to the engine
+Program prepare(const std::shared_ptr<const SourceBuffer>& source)
+{
+    Scanner scanner(source->view());
+    Parser parser(scanner);
+    auto program = parser.parse();
+    program.retain(source);
+    PassManager::defaultPipeline().run(program);
+    Resolver().resolve(program);
+    TypeInference().infer(program);
+    LoopOptimizer().optimize(program);
+    return program;
+}
+
+// Print statements still format and buffer their values, the text is then thrown away
+Output& discard()
+{
+    static std::unique_ptr<std::FILE, int (*)(std::FILE*)> null(std::fopen("/dev/null", "w"),
+                                                                &std::fclose);
+    static Output output(null.get());
+    return output;
+}
+}  // namespace
+
+TEST_CASE("Scanner::scanTokens", "[scanner]")
+{
+    for (const auto& name : Corpus)
+    {
+        auto source = load(name);
+        BENCHMARK(std::string(name)) { return Scanner(source->view()).scanTokens(); };
+    }
+}
+
+TEST_CASE("Parser::parse", "[parser]")
+{
+    for (const auto& name : Corpus)
+    {
+        auto source = load(name);
+        BENCHMARK(std::string(name))
+        {
+            Scanner scanner(source->view());
+            return Parser(scanner).parse();
+        };
+    }
+}
+
+TEST_CASE("Environment::get/assign", "[environment]")
+{
+    // A chain as deep as the blocks of deep_scopes.lox, every level holding a few slots
+    constexpr int Depth = 8;
+    constexpr int Slots = 4;
+    std::vector<std::unique_ptr<Environment>> chain;
+    chain.push_back(std::make_unique<Environment>());
+    for (int level = 1; level < Depth; level++)
+    {
+        chain.push_back(std::make_unique<Environment>(chain.back().get()));
+    }
+    for (auto& environment : chain)
+    {
+        for (int slot = 0; slot < Slots; slot++)
+        {
+            environment->define(slot, Value(static_cast<double>(slot)));
+        }
+    }
+    auto& innermost = *chain.back();
+
+    BENCHMARK("get")
+    {
+        double sum = 0;
+        for (int depth = 0; depth < Depth; depth++)
+        {
+            for (int slot = 0; slot < Slots; slot++)
+            {
+                sum += innermost.get(depth, slot).asNumber();
+            }
+        }
+        return sum;
+    };
+    BENCHMARK("assign")
+    {
+        for (int depth = 0; depth < Depth; depth++)
+        {
+            for (int slot = 0; slot < Slots; slot++)
+            {
+                innermost.assign(depth, slot, Value(static_cast<double>(depth)));
+            }
+        }
+    };
+}
+
+TEST_CASE("Interpreter::interpret", "[interpreter]")
+{
+    for (const auto& name : Corpus)
+    {
+        auto source = load(name);
+        // Each run gets a program of its own, running one leaves jit state in its loops
+        BENCHMARK_ADVANCED(std::string(name))(Catch::Benchmark::Chronometer meter)
+        {
+            std::vector<Program> programs;
+            programs.reserve(meter.runs());
+            for (int run = 0; run < meter.runs(); run++)
+            {
+                programs.push_back(prepare(source));
+            }
+            meter.measure([&](int run) {
+                Interpreter interpreter(discard());
+                return interpreter.interpret(programs[run]);
+            });
+        };
+    }
+}
+}  // namespace lox
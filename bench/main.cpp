@@ -0,0 +1,83 @@
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
+
+#include <string>
+#include <vector>
+
+namespace lox
+{
+namespace
+{
+// Writes the result of every benchmark as one JSON document once the run ends, selected with
+// `lox_bench -r json`. Times are in nanoseconds.
+class JsonReporter : public Catch::StreamingReporterBase<JsonReporter>
+{
+public:
+    using StreamingReporterBase::StreamingReporterBase;
+
+    static std::string getDescription() { return "Benchmark results as JSON"; }
+
+    void assertionStarting(const Catch::AssertionInfo& /*info*/) override {}
+    bool assertionEnded(const Catch::AssertionStats& /*stats*/) override { return true; }
+
+    void benchmarkEnded(const Catch::BenchmarkStats<>& stats) override
+    {
+        m_results.push_back(
+            {currentTestCaseInfo->name, stats.info.name, stats.info.iterations,
+             static_cast<int>(stats.samples.size()), stats.mean.point.count(),
+             stats.mean.lower_bound.count(), stats.mean.upper_bound.count(),
+             stats.standardDeviation.point.count()});
+    }
+
+    void testRunEnded(const Catch::TestRunStats& stats) override
+    {
+        stream << "{\n  \"benchmarks\": [";
+        const char* separator = "\n";
+        for (const auto& result : m_results)
+        {
+            stream << separator << "    {\"test_case\": " << quote(result.test_case)
+                   << ", \"name\": " << quote(result.name)
+                   << ", \"iterations\": " << result.iterations
+                   << ", \"samples\": " << result.samples << ", \"mean\": " << result.mean
+                   << ", \"mean_lower\": " << result.mean_lower
+                   << ", \"mean_upper\": " << result.mean_upper
+                   << ", \"standard_deviation\": " << result.standard_deviation << "}";
+            separator = ",\n";
+        }
+        stream << "\n  ]\n}\n";
+        StreamingReporterBase::testRunEnded(stats);
+    }
+
+private:
+    struct Result
+    {
+        std::string test_case;
+        std::string name;
+        int iterations;
+        int samples;
+        double mean;
+        double mean_lower;
+        double mean_upper;
+        double standard_deviation;
+    };
+
+    static std::string quote(const std::string& text)
+    {
+        std::string quoted = "\"";
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                quoted += '\\';
+            }
+            quoted += c;
+        }
+        return quoted + "\"";
+    }
+
+    std::vector<Result> m_results;
+};
+
+CATCH_REGISTER_REPORTER("json", JsonReporter)
+}  // namespace
+}  // namespace lox
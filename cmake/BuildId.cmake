@@ -0,0 +1,22 @@
+# Writes OUTPUT, a header defining LOX_BUILD_ID as a hash of COMPILER and of the files matching
+# the comma separated SOURCES globs. Run on every build, the header is only rewritten when the
+# id changes, so nothing is recompiled for it otherwise.
+string(REPLACE "," ";" SOURCES "${SOURCES}")
+file(GLOB files ${SOURCES})
+list(SORT files)
+set(digests "${COMPILER}")
+foreach(file ${files})
+    file(SHA256 ${file} digest)
+    get_filename_component(name ${file} NAME)
+    string(APPEND digests "\n${name} ${digest}")
+endforeach()
+string(SHA256 id "${digests}")
+
+set(content "#pragma once\n// Generated by cmake/BuildId.cmake\n#define LOX_BUILD_ID \"${id}\"\n")
+set(previous "")
+if(EXISTS ${OUTPUT})
+    file(READ ${OUTPUT} previous)
+endif()
+if(NOT previous STREQUAL content)
+    file(WRITE ${OUTPUT} "${content}")
+endif()
@@ -3,19 +3,26 @@
 #include <spdlog/spdlog.h>
 
 #include <filesystem>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <optional>
+#include <string_view>
 
 #include "ast_visitor.hpp"
+#include "closure_engine.hpp"
 #include "exception.hpp"
+#include "output.hpp"
 #include "parser.hpp"
+#include "profiler.hpp"
 #include "scanner.hpp"
+#include "stats.hpp"
+#include "vm.hpp"
 
 namespace lox
 {
 const int EXIT_RESULT_OK = 0;
 const int EXIT_RESULT_PARSE_ERROR = 1;
+// --profile=out.folded picks the file the folded stacks are written to
+constexpr std::string_view Profile_Prefix = "--profile=";
 
 int Application::start()
 {
@@ -26,44 +33,245 @@ int Application::start()
         spdlog::set_level(spdlog::level::trace);
     }
 
-    if (m_args.size() == 1)
+    if (!parseArgs())
     {
-        status = runPrompt();
+        spdlog::warn("Usage: {} [--vm | --closures] [--stream] [--cache] [--dump-optimized] "
+                     "[--stats] [--profile[=file]] [script]",
+                     m_args.empty() ? "lox" : m_args[0]);
+        return 1;
+    }
+
+    if (m_stats)
+    {
+        Stats::enable();
+    }
+
+    if (m_use_vm)
+    {
+        m_engine = std::make_unique<Vm>();
     }
-    else if (m_args.size() == 2)
+    else if (m_use_closures)
     {
-        status = runFile(m_args[1]);
+        m_engine = std::make_unique<ClosureEngine>();
     }
     else
     {
-        spdlog::warn("Wrong number of args! Booo {}", m_args.size());
-        status = 1;
+        m_engine = std::make_unique<Interpreter>();
+    }
+
+    if (m_paths.empty())
+    {
+        status = runPrompt();
+    }
+    else
+    {
+        auto directory = m_use_cache ? AstCache::defaultDirectory() : std::filesystem::path();
+        if (m_use_cache && directory.empty())
+        {
+            spdlog::warn("No cache directory for --cache, set LOX_CACHE_DIR or HOME");
+        }
+        if (!m_stream && !directory.empty())
+        {
+            m_cache = std::make_unique<AstCache>(std::move(directory));
+        }
+        if (m_profile && !Profiler::start())
+        {
+            spdlog::warn("Cannot start the profiler, running without it");
+            m_profile = false;
+        }
+        status = runFile(m_paths[0]);
+        if (m_profile)
+        {
+            Profiler::stop();
+        }
+    }
+
+    // Printed values first so the report comes last
+    Output::standard().flush();
+    Stats::report();
+    if (m_profile)
+    {
+        Profiler::report(m_paths[0], m_folded_path);
     }
     return status;
 }
 
-int Application::run(const std::string& source)
+bool Application::parseArgs()
+{
+    for (std::size_t i = 1; i < m_args.size(); i++)
+    {
+        const auto& arg = m_args[i];
+        if (arg == "--vm")
+        {
+            m_use_vm = true;
+        }
+        else if (arg == "--closures")
+        {
+            m_use_closures = true;
+        }
+        else if (arg == "--stream")
+        {
+            m_stream = true;
+        }
+        else if (arg == "--cache")
+        {
+            m_use_cache = true;
+        }
+        else if (arg == "--dump-optimized")
+        {
+            m_dump_optimized = true;
+        }
+        else if (arg == "--stats")
+        {
+            m_stats = true;
+        }
+        else if (arg == "--profile")
+        {
+            m_profile = true;
+        }
+        else if (arg.rfind(Profile_Prefix, 0) == 0)
+        {
+            m_profile = true;
+            m_folded_path = arg.substr(Profile_Prefix.size());
+        }
+        else if (arg.rfind("--", 0) == 0)
+        {
+            spdlog::warn("Unknown option {}", arg);
+            return false;
+        }
+        else
+        {
+            m_paths.push_back(arg);
+        }
+    }
+
+    if (m_use_vm && m_use_closures)
+    {
+        spdlog::warn("Only one of --vm and --closures can be given");
+        return false;
+    }
+
+    if (m_profile && (m_use_vm || m_use_closures || m_paths.empty()))
+    {
+        spdlog::warn("--profile needs a script and the tree walking interpreter");
+        return false;
+    }
+
+    if (m_paths.size() > 1)
+    {
+        spdlog::warn("Wrong number of args! Booo {}", m_args.size());
+        return false;
+    }
+
+    // The script may live in a directory that is not ours to write to
+    if (m_profile && m_folded_path.empty())
+    {
+        m_folded_path = std::filesystem::path(m_paths[0]).filename().string() + ".folded";
+    }
+    return true;
+}
+
+int Application::run(const std::shared_ptr<const SourceBuffer>& source)
 {
     int result{EXIT_RESULT_OK};
-    Scanner scanner(source);
-    auto tokens = scanner.scanTokens();
+    Scanner scanner(source->view());
+    Parser parser(scanner);
 
-    for (auto& token : tokens)
+    if (m_stream)
     {
-        spdlog::debug("Found token {}", token.repr());
+        // Only one declaration is alive at a time, a runtime error stops the rest
+        while (auto* program = nextProgram(parser))
+        {
+            if (m_dump_optimized)
+            {
+                m_passes.run(*program);
+                dump(*program);
+                continue;
+            }
+            analyze(*program);
+            if (!execute(*program))
+            {
+                break;
+            }
+        }
+        return result;
     }
 
-    Parser parser(std::move(tokens));
-    auto program = parser.parse();
-    m_interpreter.interpret(std::move(program));
+    std::optional<Program> program;
+    bool parsed{false};
+    {
+        Stats::Scope scope(Stats::Phase::Parse);
+        if (m_cache)
+        {
+            program = m_cache->load(*source);
+        }
+        if (!program)
+        {
+            if (Stats::enabled())
+            {
+                // Up front so scanning is timed apart, streamed declarations are scanned
+                // while they are parsed and their scanning counts as parse time
+                Stats::Scope scan(Stats::Phase::Scan);
+                scanner.scanAhead();
+            }
+            program = parser.parse();
+            parsed = true;
+        }
+    }
+    // Writing the entry is not part of parsing
+    if (parsed && m_cache && !scanner.hadError() && !parser.hadError())
+    {
+        m_cache->store(*source, *program);
+    }
+    program->retain(source);
+    if (m_dump_optimized)
+    {
+        m_passes.run(*program);
+        dump(*program);
+        return result;
+    }
+    analyze(*program);
+    execute(*program);
 
     return result;
 }
 
+Program* Application::nextProgram(Parser& parser)
+{
+    Stats::Scope scope(Stats::Phase::Parse);
+    return parser.next();
+}
+
+void Application::analyze(Program& program)
+{
+    Stats::Scope scope(Stats::Phase::Analyze);
+    m_passes.run(program);
+    m_resolver.resolve(program);
+    m_types.infer(program);
+    m_loops.optimize(program);
+    if (m_profile)
+    {
+        Profiler::annotate(program);
+    }
+}
+
+bool Application::execute(Program& program)
+{
+    Stats::Scope scope(Stats::Phase::Execute);
+    if (m_engine->interpret(program))
+    {
+        return true;
+    }
+    // Slots of declarations that did not run are handed out again
+    m_resolver.forgetGlobals(m_engine->definedGlobals());
+    return false;
+}
+
 int Application::runPrompt()
 {
     while (true)
     {
+        Output::standard().flush();
         std::cout << "> ";
         std::string line;
         std::getline(std::cin, line);
@@ -71,7 +279,7 @@ int Application::runPrompt()
         {
             break;
         }
-        run(line);
+        run(SourceBuffer::fromString(std::move(line)));
         m_hadError = false;
     }
     return 0;
@@ -82,35 +290,35 @@ int Application::runFile(const std::string& filepath)
     int status{0};
     spdlog::debug("Opening file {}", filepath);
 
-    std::filesystem::path path{filepath};
-    std::ifstream file;
     try
     {
-        std::ostringstream buf;
-        file.open(path);
-        if (!file.fail())
+        auto result = run(SourceBuffer::fromFile(filepath));
+        if (m_hadError || result != 0)
         {
-            buf << file.rdbuf();
-            auto result = run(buf.str());
-            if (m_hadError || result != 0)
-            {
-                spdlog::error("Error reading file {}", filepath);
-                status = EXIT_RESULT_PARSE_ERROR;
-            }
-        }
-        else
-        {
-            spdlog::error("Error opening file {}", filepath);
+            spdlog::error("Error reading file {}", filepath);
+            status = EXIT_RESULT_PARSE_ERROR;
         }
     }
-    catch (std::ifstream::failure& e)
+    catch (IoError& e)
     {
-        spdlog::error("Failed operating on file '{}'", e.what(), e.code().value());
+        spdlog::error(e.what());
     }
 
     return status;
 }
 
+void Application::dump(Program& program)
+{
+    AstPrinter printer;
+    for (auto& statement : program.statements())
+    {
+        if (statement != nullptr)
+        {
+            spdlog::info(printer.print(*statement));
+        }
+    }
+}
+
 void Application::error(int line, const std::string& message) { report(line, "", message); }
 
 void Application::runtimeError(const RuntimeError& error)
@@ -121,6 +329,8 @@ void Application::runtimeError(const RuntimeError& error)
 
 void Application::report(int line, const std::string& where, const std::string& message)
 {
+    // Scanning errors show up after the values printed before them, as runtime errors do
+    Output::standard().flush();
     spdlog::error("[line {}] Error {}: {}", line, where, message);
 }
 }  // namespace lox
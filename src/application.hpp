@@ -1,8 +1,17 @@
 #pragma once
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "ast_cache.hpp"
+#include "engine.hpp"
+#include "pass_manager.hpp"
 #include "interpreter.hpp"
+#include "loop_optimizer.hpp"
+#include "parser.hpp"
+#include "resolver.hpp"
+#include "source_buffer.hpp"
+#include "type_inference.hpp"
 
 namespace lox
 {
@@ -16,7 +25,7 @@ public:
     Application(const Application&) = delete;
     Application& operator=(const Application&) = delete;
 
-    int run(const std::string& source);
+    int run(const std::shared_ptr<const SourceBuffer>& source);
     int runFile(const std::string& filepath);
     int runPrompt();
 
@@ -26,7 +35,37 @@ public:
 
 private:
     bool m_hadError{false};
+    // Returns false if the arguments are not understood
+    bool parseArgs();
+    // Prints the statements of an optimized program instead of running it
+    static void dump(Program& program);
+    static Program* nextProgram(Parser& parser);
+    // Runs the passes and the static analyses the engines rely on
+    void analyze(Program& program);
+    // Returns false if execution stopped on an error
+    bool execute(Program& program);
+
     const std::vector<std::string> m_args;
-    Interpreter m_interpreter;
+    std::vector<std::string> m_paths;
+    bool m_use_vm{false};
+    bool m_use_closures{false};
+    // Execute each top level declaration as soon as it is parsed
+    bool m_stream{false};
+    // Opt in, nothing evicts old entries from the cache directory
+    bool m_use_cache{false};
+    bool m_dump_optimized{false};
+    // Report timings and counts once the script has run
+    bool m_stats{false};
+    // Sample the lines being executed, reported like the stats
+    bool m_profile{false};
+    // Where the folded stacks go, the working directory unless --profile names a file
+    std::string m_folded_path;
+    // Parsed programs of unchanged scripts, only set when running a file
+    std::unique_ptr<AstCache> m_cache;
+    PassManager m_passes{PassManager::defaultPipeline()};
+    Resolver m_resolver;
+    TypeInference m_types;
+    LoopOptimizer m_loops;
+    std::unique_ptr<Engine> m_engine;
 };
 }  // namespace lox
@@ -0,0 +1,90 @@
+#include "arena.hpp"
+
+#include <cstdint>
+
+namespace lox
+{
+Arena::Arena(Arena&& other) noexcept
+    : m_blocks(std::move(other.m_blocks)),
+      m_destructors(std::move(other.m_destructors)),
+      m_current(std::exchange(other.m_current, nullptr)),
+      m_end(std::exchange(other.m_end, nullptr)),
+      m_capacity(std::exchange(other.m_capacity, 0)),
+      m_first_block_size(std::exchange(other.m_first_block_size, 0))
+{
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        m_blocks = std::move(other.m_blocks);
+        m_destructors = std::move(other.m_destructors);
+        m_current = std::exchange(other.m_current, nullptr);
+        m_end = std::exchange(other.m_end, nullptr);
+        m_capacity = std::exchange(other.m_capacity, 0);
+        m_first_block_size = std::exchange(other.m_first_block_size, 0);
+    }
+    return *this;
+}
+
+Arena::~Arena() { release(); }
+
+void Arena::destroyObjects()
+{
+    for (auto destructor = m_destructors.rbegin(); destructor != m_destructors.rend();
+         destructor++)
+    {
+        destructor->destroy(destructor->object);
+    }
+    m_destructors.clear();
+}
+
+void Arena::release()
+{
+    destroyObjects();
+    m_blocks.clear();
+    m_current = nullptr;
+    m_end = nullptr;
+    m_capacity = 0;
+    m_first_block_size = 0;
+}
+
+void Arena::reset()
+{
+    if (m_blocks.empty())
+    {
+        return;
+    }
+    destroyObjects();
+    m_blocks.resize(1);
+    m_current = m_blocks.front().get();
+    m_end = m_current + m_first_block_size;
+    m_capacity = m_first_block_size;
+}
+
+void* Arena::allocate(std::size_t size, std::size_t alignment)
+{
+    auto current = reinterpret_cast<std::uintptr_t>(m_current);
+    auto aligned = (current + alignment - 1) & ~(alignment - 1);
+    if (m_current == nullptr || aligned + size > reinterpret_cast<std::uintptr_t>(m_end))
+    {
+        // Oversized requests get a block of their own
+        auto block_size = size + alignment > Block_Size ? size + alignment : Block_Size;
+        // Not make_unique, the memory does not need zeroing
+        m_blocks.emplace_back(new std::byte[block_size]);
+        if (m_blocks.size() == 1)
+        {
+            m_first_block_size = block_size;
+        }
+        m_current = m_blocks.back().get();
+        m_end = m_current + block_size;
+        m_capacity += block_size;
+        current = reinterpret_cast<std::uintptr_t>(m_current);
+        aligned = (current + alignment - 1) & ~(alignment - 1);
+    }
+    m_current += (aligned - current) + size;
+    return reinterpret_cast<void*>(aligned);
+}
+}  // namespace lox
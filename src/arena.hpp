@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lox
+{
+// Bump allocator that frees everything it handed out in one go when destroyed.
+// Destructors are only recorded for objects that need them and are run in reverse order
+// of construction from a flat list, so tearing down a deep tree never recurses.
+class Arena
+{
+public:
+    Arena() = default;
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+    ~Arena();
+
+    // Delete undesired constructors (Allow move, not copy or assign)
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    template <typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        void* memory = allocate(sizeof(T), alignof(T));
+        T* object = new (memory) T(std::forward<Args>(args)...);
+        if constexpr (!triviallyDestructible<T>())
+        {
+            m_destructors.push_back(Destructor{object, [](void* pointer) {
+                                                   static_cast<T*>(pointer)->~T();
+                                               }});
+        }
+        return object;
+    }
+
+    void* allocate(std::size_t size, std::size_t alignment);
+
+    // Destroys everything handed out so far but keeps the first block for reuse
+    void reset();
+
+    // Total bytes reserved from the system, for diagnostics
+    [[nodiscard]] std::size_t capacity() const { return m_capacity; }
+
+private:
+    static constexpr std::size_t Block_Size = 64 * 1024;
+
+    struct Destructor
+    {
+        void* object;
+        void (*destroy)(void*);
+    };
+
+    // Generated AST nodes are polymorphic and so never trivially destructible, they
+    // advertise whether their members need cleanup instead
+    template <typename T>
+    static constexpr bool triviallyDestructible()
+    {
+        if constexpr (hasMemberTrait<T>(0))
+        {
+            return T::Trivially_Destructible_Members;
+        }
+        else
+        {
+            return std::is_trivially_destructible_v<T>;
+        }
+    }
+    template <typename T>
+    static constexpr auto hasMemberTrait(int) -> decltype(T::Trivially_Destructible_Members, true)
+    {
+        return true;
+    }
+    template <typename T>
+    static constexpr bool hasMemberTrait(...)
+    {
+        return false;
+    }
+
+    void destroyObjects();
+    void release();
+
+    std::vector<std::unique_ptr<std::byte[]>> m_blocks;
+    std::vector<Destructor> m_destructors;
+    std::byte* m_current{nullptr};
+    std::byte* m_end{nullptr};
+    std::size_t m_capacity{0};
+    std::size_t m_first_block_size{0};
+};
+}  // namespace lox
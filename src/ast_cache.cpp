@@ -0,0 +1,535 @@
+#include "ast_cache.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unistd.h>
+
+#include "build_id.hpp"
+#include "exception.hpp"
+
+namespace lox
+{
+namespace
+{
+constexpr std::uint32_t Magic = 0x41584f4c;  // "LOXA"
+// Changes with any source file or the compiler, see cmake/BuildId.cmake
+constexpr std::string_view Build_Id = LOX_BUILD_ID;
+
+enum class NodeTag : std::uint8_t
+{
+    Null,
+    ExpressionAssign,
+    ExpressionBinary,
+    ExpressionGrouping,
+    ExpressionLiteral,
+    ExpressionLogical,
+    ExpressionUnary,
+    ExpressionVariable,
+    StatementBlock,
+    StatementExpression,
+    StatementIf,
+    StatementPrint,
+    StatementVariable,
+    StatementWhile,
+};
+
+std::uint64_t fnv1a(std::string_view text, std::uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    for (char c : text)
+    {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+std::uint64_t sourceHash(std::string_view text)
+{
+    auto version = AstCache::Format_Version;
+    auto hash = fnv1a(std::string_view(reinterpret_cast<const char*>(&version), sizeof(version)));
+    return fnv1a(text, fnv1a(Build_Id, hash));
+}
+
+// Serializes a tree depth first, every node is its tag followed by its members in declaration
+// order. Annotations are left out, the resolver fills them in again after loading.
+class AstWriter : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    AstWriter(std::string_view source, std::uint64_t hash) : m_source(source), m_hash(hash) {}
+
+    void writeProgram(Program& program)
+    {
+        put(Magic);
+        put(AstCache::Format_Version);
+        m_out.append(Build_Id);
+        put(m_hash);
+        put(static_cast<std::uint64_t>(m_source.size()));
+        // The hash only names the entry, the source itself is what a load is checked against
+        m_out.append(m_source);
+        writeStatements(program.statements());
+    }
+
+    [[nodiscard]] const std::string& bytes() const { return m_out; }
+
+    void visitExpressionAssign(ExpressionAssign& expression) override
+    {
+        put(NodeTag::ExpressionAssign);
+        write(expression.getName());
+        write(expression.getValue());
+    }
+    void visitExpressionBinary(ExpressionBinary& expression) override
+    {
+        put(NodeTag::ExpressionBinary);
+        write(expression.getLeft());
+        write(expression.getToken());
+        write(expression.getRight());
+    }
+    void visitExpressionGrouping(ExpressionGrouping& expression) override
+    {
+        put(NodeTag::ExpressionGrouping);
+        write(expression.getExpression());
+    }
+    void visitExpressionLiteral(ExpressionLiteral& expression) override
+    {
+        put(NodeTag::ExpressionLiteral);
+        write(expression.getValue());
+    }
+    void visitExpressionLogical(ExpressionLogical& expression) override
+    {
+        put(NodeTag::ExpressionLogical);
+        write(expression.getLeft());
+        write(expression.getToken());
+        write(expression.getRight());
+    }
+    void visitExpressionUnary(ExpressionUnary& expression) override
+    {
+        put(NodeTag::ExpressionUnary);
+        write(expression.getToken());
+        write(expression.getExpression());
+    }
+    void visitExpressionVariable(ExpressionVariable& expression) override
+    {
+        put(NodeTag::ExpressionVariable);
+        write(expression.getName());
+    }
+
+    void visitStatementBlock(StatementBlock& statement) override
+    {
+        put(NodeTag::StatementBlock);
+        writeStatements(*statement.getStatements());
+    }
+    void visitStatementExpression(StatementExpression& statement) override
+    {
+        put(NodeTag::StatementExpression);
+        put(static_cast<std::int32_t>(statement.getLine()));
+        write(statement.getExpression());
+    }
+    void visitStatementIf(StatementIf& statement) override
+    {
+        put(NodeTag::StatementIf);
+        write(statement.getCondition());
+        write(statement.getthenBranch());
+        write(statement.getelseBranch());
+    }
+    void visitStatementPrint(StatementPrint& statement) override
+    {
+        put(NodeTag::StatementPrint);
+        put(static_cast<std::int32_t>(statement.getLine()));
+        write(statement.getExpression());
+    }
+    void visitStatementVariable(StatementVariable& statement) override
+    {
+        put(NodeTag::StatementVariable);
+        write(statement.getName());
+        write(statement.getInitializer());
+    }
+    void visitStatementWhile(StatementWhile& statement) override
+    {
+        put(NodeTag::StatementWhile);
+        write(statement.getCondition());
+        write(statement.getBody());
+    }
+
+private:
+    template <typename T>
+    void put(T value)
+    {
+        m_out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void writeStatements(StatementList& statements)
+    {
+        put(static_cast<std::uint32_t>(statements.size()));
+        for (auto& statement : statements)
+        {
+            write(rawNode(statement));
+        }
+    }
+
+    void write(Expression* expression)
+    {
+        if (expression == nullptr)
+        {
+            put(NodeTag::Null);
+            return;
+        }
+        expression->accept(*this);
+    }
+
+    void write(Statement* statement)
+    {
+        if (statement == nullptr)
+        {
+            put(NodeTag::Null);
+            return;
+        }
+        statement->accept(*this);
+    }
+
+    // Lexemes are stored as a range of the source, they always come from it
+    void write(const Token& token)
+    {
+        auto lexeme = token.lexeme();
+        std::uint32_t offset = 0;
+        if (!lexeme.empty())
+        {
+            if (lexeme.data() < m_source.data() ||
+                lexeme.data() + lexeme.size() > m_source.data() + m_source.size())
+            {
+                throw IoError("Token does not point into the source");
+            }
+            offset = static_cast<std::uint32_t>(lexeme.data() - m_source.data());
+        }
+        put(token.type());
+        put(static_cast<std::int32_t>(token.line()));
+        put(offset);
+        put(static_cast<std::uint32_t>(lexeme.size()));
+        if (token.type() == TokenType::NUMBER)
+        {
+            put(token.number());
+        }
+    }
+
+    void write(const Value& value)
+    {
+        put(value.type());
+        switch (value.type())
+        {
+        case ValueType::Nil:
+            break;
+        case ValueType::Bool:
+            put(static_cast<std::uint8_t>(value.asBool()));
+            break;
+        case ValueType::Number:
+            put(value.asNumber());
+            break;
+        case ValueType::String:
+            put(static_cast<std::uint32_t>(value.asString().size()));
+            m_out.append(value.asString());
+            break;
+        }
+    }
+
+    std::string_view m_source;
+    std::uint64_t m_hash;
+    std::string m_out;
+};
+
+// Rebuilds a tree written by AstWriter into a fresh Program. Malformed input raises IoError.
+class AstReader
+{
+public:
+    AstReader(std::string_view bytes, std::string_view source, std::uint64_t hash)
+        : m_bytes(bytes), m_source(source), m_hash(hash)
+    {
+    }
+
+    // Returns false if the entry was written for other source text or by another version
+    bool readHeader()
+    {
+        if (get<std::uint32_t>() != Magic || get<std::uint32_t>() != AstCache::Format_Version ||
+            m_bytes.size() - m_pos < Build_Id.size() ||
+            m_bytes.substr(m_pos, Build_Id.size()) != Build_Id)
+        {
+            return false;
+        }
+        m_pos += Build_Id.size();
+        if (get<std::uint64_t>() != m_hash || get<std::uint64_t>() != m_source.size())
+        {
+            return false;
+        }
+        if (m_bytes.size() - m_pos < m_source.size())
+        {
+            throw IoError("Truncated cache entry");
+        }
+        auto source = m_bytes.substr(m_pos, m_source.size());
+        m_pos += m_source.size();
+        return source == m_source;
+    }
+
+    Program readProgram()
+    {
+        readStatements(m_program.statements());
+        if (m_pos != m_bytes.size())
+        {
+            throw IoError("Trailing bytes in cache entry");
+        }
+        return std::move(m_program);
+    }
+
+private:
+    template <typename T>
+    T get()
+    {
+        if (m_bytes.size() - m_pos < sizeof(T))
+        {
+            throw IoError("Truncated cache entry");
+        }
+        T value;
+        std::memcpy(&value, m_bytes.data() + m_pos, sizeof(T));
+        m_pos += sizeof(T);
+        return value;
+    }
+
+    void readStatements(StatementList& statements)
+    {
+        auto count = get<std::uint32_t>();
+        statements.reserve(count);
+        for (std::uint32_t i = 0; i < count; i++)
+        {
+            statements.emplace_back(readStatement());
+        }
+    }
+
+    Token readToken()
+    {
+        auto type = get<TokenType>();
+        auto line = get<std::int32_t>();
+        auto offset = get<std::uint32_t>();
+        auto size = get<std::uint32_t>();
+        if (offset > m_source.size() || size > m_source.size() - offset)
+        {
+            throw IoError("Token out of range in cache entry");
+        }
+        auto lexeme = m_source.substr(offset, size);
+        if (type == TokenType::NUMBER)
+        {
+            return Token{type, lexeme, get<double>(), line};
+        }
+        return Token{type, lexeme, line};
+    }
+
+    Value readValue()
+    {
+        switch (get<ValueType>())
+        {
+        case ValueType::Nil:
+            return Value();
+        case ValueType::Bool:
+            return Value(get<std::uint8_t>() != 0);
+        case ValueType::Number:
+            return Value(get<double>());
+        case ValueType::String:
+        {
+            auto size = get<std::uint32_t>();
+            if (m_bytes.size() - m_pos < size)
+            {
+                throw IoError("Truncated cache entry");
+            }
+            auto text = m_bytes.substr(m_pos, size);
+            m_pos += size;
+            return Value::intern(text);
+        }
+        }
+        throw IoError("Unknown value type in cache entry");
+    }
+
+    ExpressionPtr readExpression()
+    {
+        switch (get<NodeTag>())
+        {
+        case NodeTag::Null:
+            return nullptr;
+        case NodeTag::ExpressionAssign:
+        {
+            auto name = readToken();
+            auto value = readExpression();
+            return m_program.make<ExpressionAssign>(name, std::move(value));
+        }
+        case NodeTag::ExpressionBinary:
+        {
+            auto left = readExpression();
+            auto token = readToken();
+            auto right = readExpression();
+            return m_program.make<ExpressionBinary>(std::move(left), token, std::move(right));
+        }
+        case NodeTag::ExpressionGrouping:
+            return m_program.make<ExpressionGrouping>(readExpression());
+        case NodeTag::ExpressionLiteral:
+            return m_program.make<ExpressionLiteral>(readValue());
+        case NodeTag::ExpressionLogical:
+        {
+            auto left = readExpression();
+            auto token = readToken();
+            auto right = readExpression();
+            return m_program.make<ExpressionLogical>(std::move(left), token, std::move(right));
+        }
+        case NodeTag::ExpressionUnary:
+        {
+            auto token = readToken();
+            return m_program.make<ExpressionUnary>(token, readExpression());
+        }
+        case NodeTag::ExpressionVariable:
+            return m_program.make<ExpressionVariable>(readToken());
+        default:
+            throw IoError("Expected an expression in cache entry");
+        }
+    }
+
+    StatementPtr readStatement()
+    {
+        switch (get<NodeTag>())
+        {
+        case NodeTag::Null:
+            return nullptr;
+        case NodeTag::StatementBlock:
+        {
+            auto statements = m_program.make<StatementList>();
+            readStatements(*statements);
+            return m_program.make<StatementBlock>(std::move(statements));
+        }
+        case NodeTag::StatementExpression:
+        {
+            int line = get<std::int32_t>();
+            return m_program.make<StatementExpression>(line, readExpression());
+        }
+        case NodeTag::StatementIf:
+        {
+            auto condition = readExpression();
+            auto then_branch = readStatement();
+            auto else_branch = readStatement();
+            return m_program.make<StatementIf>(std::move(condition), std::move(then_branch),
+                                               std::move(else_branch));
+        }
+        case NodeTag::StatementPrint:
+        {
+            int line = get<std::int32_t>();
+            return m_program.make<StatementPrint>(line, readExpression());
+        }
+        case NodeTag::StatementVariable:
+        {
+            auto name = readToken();
+            return m_program.make<StatementVariable>(name, readExpression());
+        }
+        case NodeTag::StatementWhile:
+        {
+            auto condition = readExpression();
+            auto body = readStatement();
+            return m_program.make<StatementWhile>(std::move(condition), std::move(body));
+        }
+        default:
+            throw IoError("Expected a statement in cache entry");
+        }
+    }
+
+    std::string_view m_bytes;
+    std::size_t m_pos{0};
+    std::string_view m_source;
+    std::uint64_t m_hash;
+    Program m_program;
+};
+}  // namespace
+
+std::filesystem::path AstCache::defaultDirectory()
+{
+    if (const char* directory = std::getenv("LOX_CACHE_DIR"))
+    {
+        return directory;
+    }
+    if (const char* directory = std::getenv("XDG_CACHE_HOME"))
+    {
+        return std::filesystem::path(directory) / "lox";
+    }
+    if (const char* directory = std::getenv("HOME"))
+    {
+        return std::filesystem::path(directory) / ".cache" / "lox";
+    }
+    return {};
+}
+
+std::filesystem::path AstCache::entryPath(std::uint64_t hash) const
+{
+    return m_directory / fmt::format("{:016x}.ast", hash);
+}
+
+std::optional<Program> AstCache::load(const SourceBuffer& source) const
+{
+    auto hash = sourceHash(source.view());
+    auto path = entryPath(hash);
+    std::error_code error;
+    if (!std::filesystem::exists(path, error))
+    {
+        spdlog::debug("No cache entry {}", path.string());
+        return std::nullopt;
+    }
+    try
+    {
+        auto entry = SourceBuffer::fromFile(path.string());
+        AstReader reader(entry->view(), source.view(), hash);
+        if (!reader.readHeader())
+        {
+            spdlog::debug("Stale cache entry {}", path.string());
+            return std::nullopt;
+        }
+        auto program = reader.readProgram();
+        spdlog::debug("Loaded cache entry {}", path.string());
+        return program;
+    }
+    catch (IoError& e)
+    {
+        spdlog::debug("Ignoring cache entry {}: {}", path.string(), e.what());
+        return std::nullopt;
+    }
+}
+
+void AstCache::store(const SourceBuffer& source, Program& program) const
+{
+    try
+    {
+        auto hash = sourceHash(source.view());
+        AstWriter writer(source.view(), hash);
+        writer.writeProgram(program);
+
+        std::filesystem::create_directories(m_directory);
+        auto path = entryPath(hash);
+        // Written aside and renamed so concurrent runs never see a partial entry
+        auto temporary = path;
+        temporary += fmt::format(".{}.tmp", ::getpid());
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(writer.bytes().data(), static_cast<std::streamsize>(writer.bytes().size()));
+            if (!file)
+            {
+                std::filesystem::remove(temporary);
+                throw IoError("Cannot write " + temporary.string());
+            }
+        }
+        std::filesystem::rename(temporary, path);
+        spdlog::debug("Stored cache entry {}", path.string());
+    }
+    catch (std::filesystem::filesystem_error& e)
+    {
+        spdlog::debug("Not caching program: {}", e.what());
+    }
+    catch (IoError& e)
+    {
+        spdlog::debug("Not caching program: {}", e.what());
+    }
+}
+}  // namespace lox
@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+#include "program.hpp"
+#include "source_buffer.hpp"
+
+namespace lox
+{
+// On disk cache of parsed programs so unchanged scripts skip the Scanner and Parser.
+// Entries are named by an FNV-1a hash of the source text, the format version below and the
+// build id, and hold a copy of the source that has to match for a load to succeed. The tree
+// is stored without resolver annotations, tokens are stored as offsets into the source, so a
+// loaded Program views the same SourceBuffer a fresh parse would.
+class AstCache
+{
+public:
+    // Bump whenever the encoding changes. Grammar and node changes are covered by the build
+    // id, a hash of the sources generated by CMake.
+    static constexpr std::uint32_t Format_Version = 2;
+
+    // LOX_CACHE_DIR, else $XDG_CACHE_HOME/lox, else $HOME/.cache/lox. Empty if none is set.
+    static std::filesystem::path defaultDirectory();
+
+    explicit AstCache(std::filesystem::path directory) : m_directory(std::move(directory)) {}
+
+    // Returns the cached program for source, nothing on a miss or an unusable entry
+    std::optional<Program> load(const SourceBuffer& source) const;
+
+    // Failures are logged and otherwise ignored, the cache is only an optimization
+    void store(const SourceBuffer& source, Program& program) const;
+
+private:
+    [[nodiscard]] std::filesystem::path entryPath(std::uint64_t hash) const;
+
+    std::filesystem::path m_directory;
+};
+}  // namespace lox
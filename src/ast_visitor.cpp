@@ -1,10 +1,14 @@
 #include "ast_visitor.hpp"
 
 #include <spdlog/fmt/fmt.h>
-#include <spdlog/spdlog.h>
+#include "trace.hpp"
 
 namespace lox
 {
+std::string AstPrinter::visitExpressionAssign(ExpressionAssign& expression)
+{
+    return fmt::format("(= {} {})", expression.getName().lexeme(), print(expression.getValue()));
+}
 std::string AstPrinter::visitExpressionBinary(ExpressionBinary& expression)
 {
     std::vector<Expression*> exp_vec{expression.getLeft(), expression.getRight()};
@@ -17,29 +21,90 @@ std::string AstPrinter::visitExpressionGrouping(ExpressionGrouping& expression)
 }
 std::string AstPrinter::visitExpressionLiteral(ExpressionLiteral& expression)
 {
-    assert(expression.getValue());
     return expression.getValue().repr();
 }
+std::string AstPrinter::visitExpressionLogical(ExpressionLogical& expression)
+{
+    std::vector<Expression*> exp_vec{expression.getLeft(), expression.getRight()};
+    return parenthesize(expression.getToken().lexeme(), exp_vec);
+}
 std::string AstPrinter::visitExpressionUnary(ExpressionUnary& expression)
 {
     std::vector<Expression*> exp_vec{expression.getExpression()};
     return parenthesize(expression.getToken().lexeme(), exp_vec);
-    ;
+}
+std::string AstPrinter::visitExpressionVariable(ExpressionVariable& expression)
+{
+    return std::string(expression.getName().lexeme());
+}
+
+std::string AstPrinter::visitStatementBlock(StatementBlock& statement)
+{
+    std::string result{"(block"};
+    for (auto& child : *statement.getStatements())
+    {
+        result.append(" ");
+        result.append(print(rawNode(child)));
+    }
+    result.append(")");
+    return result;
+}
+std::string AstPrinter::visitStatementExpression(StatementExpression& statement)
+{
+    return fmt::format("(; {})", print(statement.getExpression()));
+}
+std::string AstPrinter::visitStatementIf(StatementIf& statement)
+{
+    if (statement.getelseBranch() == nullptr)
+    {
+        return fmt::format("(if {} {})", print(statement.getCondition()),
+                           print(statement.getthenBranch()));
+    }
+    return fmt::format("(if {} {} {})", print(statement.getCondition()),
+                       print(statement.getthenBranch()), print(statement.getelseBranch()));
+}
+std::string AstPrinter::visitStatementPrint(StatementPrint& statement)
+{
+    return fmt::format("(print {})", print(statement.getExpression()));
+}
+std::string AstPrinter::visitStatementVariable(StatementVariable& statement)
+{
+    if (statement.getInitializer() == nullptr)
+    {
+        return fmt::format("(var {})", statement.getName().lexeme());
+    }
+    return fmt::format("(var {} {})", statement.getName().lexeme(),
+                       print(statement.getInitializer()));
+}
+std::string AstPrinter::visitStatementWhile(StatementWhile& statement)
+{
+    return fmt::format("(while {} {})", print(statement.getCondition()),
+                       print(statement.getBody()));
 }
 
-std::string AstPrinter::parenthesize(const std::string& name,
+std::string AstPrinter::parenthesize(std::string_view name,
                                      const std::vector<Expression*>& expressions)
 {
-    spdlog::trace("Parenthesizing {} with tokens", name);
+    LOX_TRACE("Parenthesizing {} with tokens", name);
     std::string result{"("};
     result.append(name);
     for (auto* expression : expressions)
     {
         result.append(" ");
-        result.append(expression->accept(*this));
+        result.append(print(expression));
     }
     result.append(")");
     return result;
 }
 
+std::string AstPrinter::print(Expression* expression)
+{
+    return expression != nullptr ? expression->accept(*this) : "<error>";
+}
+
+std::string AstPrinter::print(Statement* statement)
+{
+    return statement != nullptr ? statement->accept(*this) : "<error>";
+}
+
 }  // namespace lox
@@ -1,24 +1,40 @@
 #pragma once
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "expression_ast.hpp"
+#include "statement_ast.hpp"
 
 namespace lox
 {
-class AstPrinter : public ExpressionVisitorString
+// Renders a tree as parenthesized prefix notation, e.g. (print (+ 1 (group x)))
+class AstPrinter : public ExpressionVisitorString, public StatementVisitorString
 {
 public:
     std::string print(Expression& expr) { return expr.accept(*this); }
+    std::string print(Statement& statement) { return statement.accept(*this); }
 
+    [[nodiscard]] std::string visitExpressionAssign(ExpressionAssign& expression) override;
     [[nodiscard]] std::string visitExpressionBinary(ExpressionBinary& expression) override;
     [[nodiscard]] std::string visitExpressionGrouping(ExpressionGrouping& expression) override;
     [[nodiscard]] std::string visitExpressionLiteral(ExpressionLiteral& expression) override;
+    [[nodiscard]] std::string visitExpressionLogical(ExpressionLogical& expression) override;
     [[nodiscard]] std::string visitExpressionUnary(ExpressionUnary& expression) override;
+    [[nodiscard]] std::string visitExpressionVariable(ExpressionVariable& expression) override;
+
+    [[nodiscard]] std::string visitStatementBlock(StatementBlock& statement) override;
+    [[nodiscard]] std::string visitStatementExpression(StatementExpression& statement) override;
+    [[nodiscard]] std::string visitStatementIf(StatementIf& statement) override;
+    [[nodiscard]] std::string visitStatementPrint(StatementPrint& statement) override;
+    [[nodiscard]] std::string visitStatementVariable(StatementVariable& statement) override;
+    [[nodiscard]] std::string visitStatementWhile(StatementWhile& statement) override;
 
 private:
-    [[nodiscard]] std::string parenthesize(const std::string& name,
+    [[nodiscard]] std::string parenthesize(std::string_view name,
                                            const std::vector<Expression*>& expressions);
+    [[nodiscard]] std::string print(Expression* expression);
+    [[nodiscard]] std::string print(Statement* statement);
 };
 
 }  // namespace lox
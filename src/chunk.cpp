@@ -0,0 +1,212 @@
+#include "chunk.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cassert>
+#include <cstring>
+
+namespace lox
+{
+void Chunk::write(std::uint8_t byte, int line)
+{
+    if (m_lines.empty() || m_lines.back().line != line)
+    {
+        m_lines.push_back(LineStart{m_code.size(), line});
+    }
+    m_code.push_back(byte);
+}
+
+void Chunk::writeShort(std::uint16_t value, int line)
+{
+    write(static_cast<std::uint8_t>(value & 0xff), line);
+    write(static_cast<std::uint8_t>(value >> 8), line);
+}
+
+void Chunk::patchShort(std::size_t offset, std::uint16_t value)
+{
+    assert(offset + 1 < m_code.size());
+    m_code[offset] = static_cast<std::uint8_t>(value & 0xff);
+    m_code[offset + 1] = static_cast<std::uint8_t>(value >> 8);
+}
+
+void Chunk::writeLong(std::uint32_t value, int line)
+{
+    assert(value <= 0xffffff);
+    write(static_cast<std::uint8_t>(value & 0xff), line);
+    write(static_cast<std::uint8_t>((value >> 8) & 0xff), line);
+    write(static_cast<std::uint8_t>(value >> 16), line);
+}
+
+void Chunk::patchLong(std::size_t offset, std::uint32_t value)
+{
+    assert(offset + 2 < m_code.size() && value <= 0xffffff);
+    m_code[offset] = static_cast<std::uint8_t>(value & 0xff);
+    m_code[offset + 1] = static_cast<std::uint8_t>((value >> 8) & 0xff);
+    m_code[offset + 2] = static_cast<std::uint8_t>(value >> 16);
+}
+
+std::size_t Chunk::addConstant(Value value)
+{
+    auto index = m_constants.size();
+    if (value.isNumber())
+    {
+        std::uint64_t bits;
+        auto number = value.asNumber();
+        std::memcpy(&bits, &number, sizeof(bits));
+        auto [found, inserted] = m_number_constants.try_emplace(bits, index);
+        if (!inserted)
+        {
+            return found->second;
+        }
+    }
+    else if (value.isString())
+    {
+        auto found = m_string_constants.find(value.asString());
+        if (found != m_string_constants.end())
+        {
+            return found->second;
+        }
+        // The view stays valid, the constant keeps the string alive
+        m_string_constants.emplace(value.asString(), index);
+    }
+    m_constants.emplace_back(std::move(value));
+    return index;
+}
+
+int Chunk::getLine(std::size_t offset) const
+{
+    // Find the last run starting at or before offset
+    std::size_t low = 0;
+    std::size_t high = m_lines.size();
+    while (high - low > 1)
+    {
+        auto middle = (low + high) / 2;
+        if (m_lines[middle].offset <= offset)
+        {
+            low = middle;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    return m_lines.empty() ? 0 : m_lines[low].line;
+}
+
+void Chunk::disassemble(const std::string& name) const
+{
+    spdlog::debug("== {} ==", name);
+    for (std::size_t offset = 0; offset < m_code.size();)
+    {
+        offset = disassembleInstruction(offset);
+    }
+}
+
+std::size_t Chunk::disassembleInstruction(std::size_t offset) const
+{
+    auto op = static_cast<OpCode>(m_code[offset]);
+    auto operand = [this, offset]() {
+        return static_cast<int>(m_code[offset + 1] | (m_code[offset + 2] << 8));
+    };
+    auto simple = [this, offset](const char* name) {
+        spdlog::debug("{:04} {:4} {}", offset, getLine(offset), name);
+        return offset + 1;
+    };
+    auto longOperand = [this, offset]() {
+        return static_cast<int>(m_code[offset + 1] | (m_code[offset + 2] << 8) |
+                                (m_code[offset + 3] << 16));
+    };
+    auto withOperand = [this, offset, &operand](const char* name) {
+        spdlog::debug("{:04} {:4} {:<16} {}", offset, getLine(offset), name, operand());
+        return offset + 3;
+    };
+    auto withLongOperand = [this, offset, &longOperand](const char* name) {
+        spdlog::debug("{:04} {:4} {:<16} {}", offset, getLine(offset), name, longOperand());
+        return offset + 4;
+    };
+
+    switch (op)
+    {
+    case OpCode::Constant:
+        spdlog::debug("{:04} {:4} {:<16} {} '{}'", offset, getLine(offset), "CONSTANT",
+                      operand(), m_constants[operand()].repr());
+        return offset + 3;
+    case OpCode::Nil:
+        return simple("NIL");
+    case OpCode::True:
+        return simple("TRUE");
+    case OpCode::False:
+        return simple("FALSE");
+    case OpCode::Pop:
+        return simple("POP");
+    case OpCode::PopN:
+        return withOperand("POP_N");
+    case OpCode::GetGlobal:
+        return withOperand("GET_GLOBAL");
+    case OpCode::DefineGlobal:
+        return withOperand("DEFINE_GLOBAL");
+    case OpCode::SetGlobal:
+        return withOperand("SET_GLOBAL");
+    case OpCode::GetLocal:
+        return withOperand("GET_LOCAL");
+    case OpCode::SetLocal:
+        return withOperand("SET_LOCAL");
+    case OpCode::Undefined:
+        return withOperand("UNDEFINED");
+    case OpCode::Equal:
+        return simple("EQUAL");
+    case OpCode::NotEqual:
+        return simple("NOT_EQUAL");
+    case OpCode::Greater:
+        return simple("GREATER");
+    case OpCode::GreaterEqual:
+        return simple("GREATER_EQUAL");
+    case OpCode::Less:
+        return simple("LESS");
+    case OpCode::LessEqual:
+        return simple("LESS_EQUAL");
+    case OpCode::Add:
+        return simple("ADD");
+    case OpCode::Subtract:
+        return simple("SUBTRACT");
+    case OpCode::Multiply:
+        return simple("MULTIPLY");
+    case OpCode::Divide:
+        return simple("DIVIDE");
+    case OpCode::Not:
+        return simple("NOT");
+    case OpCode::Negate:
+        return simple("NEGATE");
+    case OpCode::Print:
+        return simple("PRINT");
+    case OpCode::Jump:
+        return withOperand("JUMP");
+    case OpCode::JumpIfFalse:
+        return withOperand("JUMP_IF_FALSE");
+    case OpCode::Loop:
+        return withOperand("LOOP");
+    case OpCode::Return:
+        return simple("RETURN");
+    case OpCode::ConstantLong:
+        spdlog::debug("{:04} {:4} {:<16} {} '{}'", offset, getLine(offset), "CONSTANT_LONG",
+                      longOperand(), m_constants[longOperand()].repr());
+        return offset + 4;
+    case OpCode::GetGlobalLong:
+        return withLongOperand("GET_GLOBAL_LONG");
+    case OpCode::DefineGlobalLong:
+        return withLongOperand("DEFINE_GLOBAL_LONG");
+    case OpCode::SetGlobalLong:
+        return withLongOperand("SET_GLOBAL_LONG");
+    case OpCode::UndefinedLong:
+        return withLongOperand("UNDEFINED_LONG");
+    case OpCode::JumpLong:
+        return withLongOperand("JUMP_LONG");
+    case OpCode::JumpIfFalseLong:
+        return withLongOperand("JUMP_IF_FALSE_LONG");
+    case OpCode::LoopLong:
+        return withLongOperand("LOOP_LONG");
+    }
+    spdlog::error("Unknown opcode {} at offset {}", static_cast<int>(op), offset);
+    return offset + 1;
+}
+}  // namespace lox
@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "value.hpp"
+
+namespace lox
+{
+// Operands follow the opcode inline as 16 bit little endian integers. The Long forms take a
+// 24 bit operand instead and are only emitted for operands that do not fit in 16 bits.
+enum class OpCode : std::uint8_t
+{
+    Constant,  // u16 constant index
+    Nil,
+    True,
+    False,
+    Pop,
+    PopN,  // u16 count
+    GetGlobal,     // u16 slot
+    DefineGlobal,  // u16 slot
+    SetGlobal,     // u16 slot
+    GetLocal,      // u16 stack slot
+    SetLocal,      // u16 stack slot
+    Undefined,     // u16 constant index of the variable name
+    Equal,
+    NotEqual,
+    Greater,
+    GreaterEqual,
+    Less,
+    LessEqual,
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+    Not,
+    Negate,
+    Print,
+    Jump,         // u16 forward offset
+    JumpIfFalse,  // u16 forward offset, leaves the condition on the stack
+    Loop,         // u16 backward offset
+    Return,
+    ConstantLong,      // u24 constant index
+    GetGlobalLong,     // u24 slot
+    DefineGlobalLong,  // u24 slot
+    SetGlobalLong,     // u24 slot
+    UndefinedLong,     // u24 constant index of the variable name
+    JumpLong,          // u24 forward offset
+    JumpIfFalseLong,   // u24 forward offset, leaves the condition on the stack
+    LoopLong           // u24 backward offset
+};
+
+// A compiled program: bytecode, the constants it refers to and a run length encoded line table
+class Chunk
+{
+public:
+    void write(std::uint8_t byte, int line);
+    void write(OpCode op, int line) { write(static_cast<std::uint8_t>(op), line); }
+    void writeShort(std::uint16_t value, int line);
+    void patchShort(std::size_t offset, std::uint16_t value);
+    void writeLong(std::uint32_t value, int line);
+    void patchLong(std::size_t offset, std::uint32_t value);
+
+    // Returns the index of the constant, numbers and strings already in the chunk are reused
+    std::size_t addConstant(Value value);
+
+    [[nodiscard]] int getLine(std::size_t offset) const;
+
+    [[nodiscard]] const std::vector<std::uint8_t>& code() const { return m_code; }
+    [[nodiscard]] const std::vector<Value>& constants() const { return m_constants; }
+
+    // Deepest the value stack gets while running this chunk, computed by the compiler
+    [[nodiscard]] int maxStack() const { return m_max_stack; }
+    void setMaxStack(int max_stack) { m_max_stack = max_stack; }
+    // Number of global slots this chunk may define or read
+    [[nodiscard]] int globalCount() const { return m_global_count; }
+    void setGlobalCount(int global_count) { m_global_count = global_count; }
+
+    void disassemble(const std::string& name) const;
+
+private:
+    struct LineStart
+    {
+        std::size_t offset;
+        int line;
+    };
+
+    std::size_t disassembleInstruction(std::size_t offset) const;
+
+    std::vector<std::uint8_t> m_code;
+    std::vector<Value> m_constants;
+    // Numbers by bit pattern, so 0 and -0 stay apart
+    std::unordered_map<std::uint64_t, std::size_t> m_number_constants;
+    // Views into the strings held by m_constants
+    std::unordered_map<std::string_view, std::size_t> m_string_constants;
+    std::vector<LineStart> m_lines;
+    int m_max_stack{0};
+    int m_global_count{0};
+};
+}  // namespace lox
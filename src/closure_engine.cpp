@@ -0,0 +1,542 @@
+#include "closure_engine.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+
+#include "interpreter.hpp"
+
+namespace lox
+{
+namespace
+{
+RuntimeError undefinedVariable(const Token& name)
+{
+    return RuntimeError(name, "Undefined variable " + std::string(name.lexeme()) + ".");
+}
+
+// Arithmetic and comparison operators, which only accept numbers
+template <typename Operation>
+CompiledExpression numberOperation(CompiledExpression left, CompiledExpression right,
+                                   const Token& token, Operation operation)
+{
+    return [left = std::move(left), right = std::move(right), token,
+            operation](ClosureContext& context) {
+        auto a = left(context);
+        auto b = right(context);
+        if (!a.isNumber() || !b.isNumber())
+        {
+            throw RuntimeError(token, "Operands must be a number.");
+        }
+        return Value(operation(a.asNumber(), b.asNumber()));
+    };
+}
+
+// Same with a number literal on the right (i + 1, n < 10), bound as a plain double
+template <typename Operation>
+CompiledExpression numberOperation(CompiledExpression left, double right, const Token& token,
+                                   Operation operation)
+{
+    return [left = std::move(left), right, token, operation](ClosureContext& context) {
+        auto a = left(context);
+        if (!a.isNumber())
+        {
+            throw RuntimeError(token, "Operands must be a number.");
+        }
+        return Value(operation(a.asNumber(), right));
+    };
+}
+
+// And with one on the left (1 - x, 0 < n)
+template <typename Operation>
+CompiledExpression numberOperation(double left, CompiledExpression right, const Token& token,
+                                   Operation operation)
+{
+    return [left, right = std::move(right), token, operation](ClosureContext& context) {
+        auto b = right(context);
+        if (!b.isNumber())
+        {
+            throw RuntimeError(token, "Operands must be a number.");
+        }
+        return Value(operation(left, b.asNumber()));
+    };
+}
+
+// Number literal operands of a binary expression, null for any other operand. Only one is
+// bound when both are.
+struct NumberLiterals
+{
+    ExpressionLiteral* left;
+    ExpressionLiteral* right;
+};
+
+ExpressionLiteral* numberLiteral(Expression* expression)
+{
+    auto* literal = dynamic_cast<ExpressionLiteral*>(expression);
+    return literal != nullptr && literal->getValue().isNumber() ? literal : nullptr;
+}
+
+template <typename Operation>
+CompiledExpression numberOperation(CompiledExpression left, CompiledExpression right,
+                                   NumberLiterals literals, const Token& token,
+                                   Operation operation)
+{
+    if (literals.left != nullptr)
+    {
+        return numberOperation(literals.left->getValue().asNumber(), std::move(right), token,
+                               operation);
+    }
+    if (literals.right != nullptr)
+    {
+        return numberOperation(std::move(left), literals.right->getValue().asNumber(), token,
+                               operation);
+    }
+    return numberOperation(std::move(left), std::move(right), token, operation);
+}
+
+// With a number literal on either side only numbers can be added, addition commutes
+CompiledExpression addition(CompiledExpression operand, double constant, const Token& token)
+{
+    return [operand = std::move(operand), constant, token](ClosureContext& context) {
+        auto value = operand(context);
+        if (!value.isNumber())
+        {
+            throw RuntimeError(token, "Operands must be two numbers or two strings.");
+        }
+        return Value(value.asNumber() + constant);
+    };
+}
+
+CompiledExpression addition(CompiledExpression left, CompiledExpression right,
+                            NumberLiterals literals, const Token& token)
+{
+    if (literals.left != nullptr)
+    {
+        return addition(std::move(right), literals.left->getValue().asNumber(), token);
+    }
+    if (literals.right != nullptr)
+    {
+        return addition(std::move(left), literals.right->getValue().asNumber(), token);
+    }
+    return [left = std::move(left), right = std::move(right), token](ClosureContext& context) {
+        auto a = left(context);
+        auto b = right(context);
+        if (a.isNumber() && b.isNumber())
+        {
+            return Value(a.asNumber() + b.asNumber());
+        }
+        if (a.isString() && b.isString())
+        {
+            return Value::concatenate(a, b);
+        }
+        throw RuntimeError(token, "Operands must be two numbers or two strings.");
+    };
+}
+
+template <typename Operation>
+CompiledExpression equality(CompiledExpression left, CompiledExpression right,
+                            Operation operation)
+{
+    return [left = std::move(left), right = std::move(right), operation](ClosureContext& context) {
+        auto a = left(context);
+        auto b = right(context);
+        return Value(operation(a, b));
+    };
+}
+
+void run(const std::vector<CompiledStatement>& statements, ClosureContext& context)
+{
+    for (const auto& statement : statements)
+    {
+        statement(context);
+    }
+}
+}  // namespace
+
+std::vector<CompiledStatement> ClosureCompiler::compile(Program& program)
+{
+    m_level = 0;
+    return compile(program.statements());
+}
+
+CompiledExpression ClosureCompiler::compile(Expression* expression)
+{
+    if (expression == nullptr)
+    {
+        return [](ClosureContext& /*context*/) {
+            spdlog::error("Null expression found, evaluating it as nil");
+            return Value();
+        };
+    }
+    expression->accept(*this);
+    return std::exchange(m_expression, nullptr);
+}
+
+CompiledStatement ClosureCompiler::compile(Statement* statement)
+{
+    if (statement == nullptr)
+    {
+        return nullptr;
+    }
+    statement->accept(*this);
+    return std::exchange(m_statement, nullptr);
+}
+
+std::vector<CompiledStatement> ClosureCompiler::compile(StatementList& statements)
+{
+    std::vector<CompiledStatement> compiled;
+    compiled.reserve(statements.size());
+    for (auto& statement : statements)
+    {
+        if (statement == nullptr)
+        {
+            compiled.emplace_back(
+                [](ClosureContext& /*context*/) { spdlog::error("Null statement found"); });
+            continue;
+        }
+        compiled.push_back(compile(rawNode(statement)));
+    }
+    return compiled;
+}
+
+void ClosureCompiler::visitStatementBlock(StatementBlock& statement)
+{
+    auto* statements = statement.getStatements();
+    if (statements == nullptr)
+    {
+        m_statement = [](ClosureContext& /*context*/) {};
+        return;
+    }
+    if (!statement.getScoped())
+    {
+        m_statement = [body = compile(*statements)](ClosureContext& context) {
+            run(body, context);
+        };
+        return;
+    }
+
+    m_level++;
+    auto body = compile(*statements);
+    m_level--;
+
+    m_statement = [body = std::move(body)](ClosureContext& context) {
+        auto* previous = context.environment;
+        std::unique_ptr<Environment> environment;
+        if (context.pool.empty())
+        {
+            environment = std::make_unique<Environment>(previous);
+        }
+        else
+        {
+            environment = std::move(context.pool.back());
+            context.pool.pop_back();
+            environment->reset(previous);
+        }
+        auto release = [&]() {
+            context.environment = previous;
+            environment->reset(nullptr);
+            context.pool.push_back(std::move(environment));
+        };
+
+        context.environment = environment.get();
+        try
+        {
+            run(body, context);
+        }
+        catch (RuntimeError& error)
+        {
+            release();
+            throw;
+        }
+        release();
+    };
+}
+
+void ClosureCompiler::visitStatementExpression(StatementExpression& statement)
+{
+    m_statement = [expression = compile(statement.getExpression())](ClosureContext& context) {
+        (void)expression(context);
+    };
+}
+
+void ClosureCompiler::visitStatementIf(StatementIf& statement)
+{
+    auto condition = compile(statement.getCondition());
+    auto then_branch = compile(statement.getthenBranch());
+    if (!then_branch)
+    {
+        then_branch = [](ClosureContext& /*context*/) {
+            spdlog::error("If statement found with null then branch");
+        };
+    }
+    auto else_branch = compile(statement.getelseBranch());
+    if (!else_branch)
+    {
+        m_statement = [condition = std::move(condition),
+                       then_branch = std::move(then_branch)](ClosureContext& context) {
+            if (condition(context).isTruthy())
+            {
+                then_branch(context);
+            }
+        };
+        return;
+    }
+    m_statement = [condition = std::move(condition), then_branch = std::move(then_branch),
+                   else_branch = std::move(else_branch)](ClosureContext& context) {
+        if (condition(context).isTruthy())
+        {
+            then_branch(context);
+        }
+        else
+        {
+            else_branch(context);
+        }
+    };
+}
+
+void ClosureCompiler::visitStatementPrint(StatementPrint& statement)
+{
+    m_statement = [expression = compile(statement.getExpression())](ClosureContext& context) {
+        context.output->line(expression(context).repr());
+    };
+}
+
+void ClosureCompiler::visitStatementWhile(StatementWhile& statement)
+{
+    auto body = compile(statement.getBody());
+    if (!body)
+    {
+        body = [](ClosureContext& /*context*/) { spdlog::error("Null body in while statement"); };
+    }
+    m_statement = [condition = compile(statement.getCondition()),
+                   body = std::move(body)](ClosureContext& context) {
+        while (condition(context).isTruthy())
+        {
+            body(context);
+        }
+    };
+}
+
+void ClosureCompiler::visitStatementVariable(StatementVariable& statement)
+{
+    auto slot = statement.getSlot();
+    if (statement.getInitializer() == nullptr)
+    {
+        m_statement = [slot](ClosureContext& context) { context.environment->define(slot, {}); };
+        return;
+    }
+    m_statement = [initializer = compile(statement.getInitializer()),
+                   slot](ClosureContext& context) {
+        context.environment->define(slot, initializer(context));
+    };
+}
+
+void ClosureCompiler::visitExpressionAssign(ExpressionAssign& expression)
+{
+    auto value = compile(expression.getValue());
+    if (expression.getDepth() < 0)
+    {
+        m_expression = [value = std::move(value),
+                        name = expression.getName()](ClosureContext& context) -> Value {
+            (void)value(context);
+            throw undefinedVariable(name);
+        };
+        return;
+    }
+    if (expression.getDepth() == m_level)
+    {
+        m_expression = [value = std::move(value), globals = &m_globals,
+                        slot = expression.getSlot()](ClosureContext& context) {
+            auto result = value(context);
+            globals->assign(0, slot, result);
+            return result;
+        };
+        return;
+    }
+    m_expression = [value = std::move(value), depth = expression.getDepth(),
+                    slot = expression.getSlot()](ClosureContext& context) {
+        auto result = value(context);
+        context.environment->assign(depth, slot, result);
+        return result;
+    };
+}
+
+void ClosureCompiler::visitExpressionBinary(ExpressionBinary& expression)
+{
+    const auto& token = expression.getToken();
+    NumberLiterals literals{numberLiteral(expression.getLeft()),
+                            numberLiteral(expression.getRight())};
+    auto left = compile(expression.getLeft());
+    auto right = compile(expression.getRight());
+
+    switch (token.type())
+    {
+    case TokenType::MINUS:
+        m_expression = numberOperation(std::move(left), std::move(right), literals, token,
+                                       std::minus<>());
+        break;
+    case TokenType::SLASH:
+        m_expression = numberOperation(std::move(left), std::move(right), literals, token,
+                                       std::divides<>());
+        break;
+    case TokenType::STAR:
+        m_expression = numberOperation(std::move(left), std::move(right), literals, token,
+                                       std::multiplies<>());
+        break;
+    case TokenType::PLUS:
+        m_expression = addition(std::move(left), std::move(right), literals, token);
+        break;
+    case TokenType::GREATER:
+        m_expression = numberOperation(std::move(left), std::move(right), literals, token,
+                                       std::greater<>());
+        break;
+    case TokenType::GREATER_EQUAL:
+        m_expression = numberOperation(std::move(left), std::move(right), literals, token,
+                                       std::greater_equal<>());
+        break;
+    case TokenType::LESS:
+        m_expression = numberOperation(std::move(left), std::move(right), literals, token,
+                                       std::less<>());
+        break;
+    case TokenType::LESS_EQUAL:
+        m_expression = numberOperation(std::move(left), std::move(right), literals, token,
+                                       std::less_equal<>());
+        break;
+    case TokenType::BANG_EQUAL:
+        m_expression = equality(std::move(left), std::move(right), std::not_equal_to<>());
+        break;
+    case TokenType::EQUAL_EQUAL:
+        m_expression = equality(std::move(left), std::move(right), std::equal_to<>());
+        break;
+    default:
+        spdlog::error("Unrecognized binary operator {}", token.repr());
+        m_expression = [left = std::move(left), right = std::move(right)](ClosureContext& context) {
+            (void)left(context);
+            (void)right(context);
+            return Value();
+        };
+        break;
+    }
+}
+
+void ClosureCompiler::visitExpressionLogical(ExpressionLogical& expression)
+{
+    auto left = compile(expression.getLeft());
+    auto right = compile(expression.getRight());
+    // "or" returns a truthy left side, "and" a falsey one
+    bool returns_truthy = expression.getToken().type() == TokenType::OR;
+    if (!returns_truthy && expression.getToken().type() != TokenType::AND)
+    {
+        spdlog::error("Unrecognized binary operator {}", expression.getToken().repr());
+        m_expression = [left = std::move(left), right = std::move(right)](ClosureContext& context) {
+            (void)left(context);
+            return right(context);
+        };
+        return;
+    }
+    m_expression = [left = std::move(left), right = std::move(right),
+                    returns_truthy](ClosureContext& context) {
+        auto value = left(context);
+        if (value.isTruthy() == returns_truthy)
+        {
+            return value;
+        }
+        return right(context);
+    };
+}
+
+void ClosureCompiler::visitExpressionGrouping(ExpressionGrouping& expression)
+{
+    // Nothing happens at runtime for a grouping, the inner closure takes its place
+    m_expression = compile(expression.getExpression());
+}
+
+void ClosureCompiler::visitExpressionLiteral(ExpressionLiteral& expression)
+{
+    m_expression = [value = expression.getValue()](ClosureContext& /*context*/) { return value; };
+}
+
+void ClosureCompiler::visitExpressionUnary(ExpressionUnary& expression)
+{
+    auto operand = compile(expression.getExpression());
+    switch (expression.getToken().type())
+    {
+    case TokenType::MINUS:
+        m_expression = [operand = std::move(operand),
+                        token = expression.getToken()](ClosureContext& context) {
+            auto value = operand(context);
+            if (!value.isNumber())
+            {
+                throw RuntimeError(token, "Operand must be a number.");
+            }
+            return Value(-value.asNumber());
+        };
+        break;
+    case TokenType::BANG:
+        m_expression = [operand = std::move(operand)](ClosureContext& context) {
+            return Value(!operand(context).isTruthy());
+        };
+        break;
+    default:
+        m_expression = [operand = std::move(operand)](ClosureContext& context) {
+            (void)operand(context);
+            return Value();
+        };
+        break;
+    }
+}
+
+void ClosureCompiler::visitExpressionVariable(ExpressionVariable& expression)
+{
+    auto depth = expression.getDepth();
+    auto slot = expression.getSlot();
+    if (depth < 0)
+    {
+        m_expression = [name = expression.getName()](ClosureContext& /*context*/) -> Value {
+            throw undefinedVariable(name);
+        };
+        return;
+    }
+    if (depth == m_level)
+    {
+        // Globals are read straight from their environment, without walking up to it
+        m_expression = [globals = &m_globals, slot](ClosureContext& /*context*/) {
+            return globals->get(0, slot);
+        };
+        return;
+    }
+    m_expression = [depth, slot](ClosureContext& context) {
+        return context.environment->get(depth, slot);
+    };
+}
+
+ClosureEngine::ClosureEngine(Output& output)
+    : Engine(output),
+      m_global_environment(std::make_unique<Environment>()),
+      m_compiler(*m_global_environment)
+{
+    m_context.environment = m_global_environment.get();
+    m_context.output = &m_output;
+}
+
+bool ClosureEngine::interpret(Program& program)
+{
+    // The closures refer to tokens of the program so they do not outlive this call
+    auto statements = m_compiler.compile(program);
+    try
+    {
+        run(statements, m_context);
+    }
+    catch (RuntimeError& error)
+    {
+        m_output.flush();
+        spdlog::error(error.what());
+        spdlog::error("Error found on line {} token {}", error.token().line(),
+                      error.token().lexeme());
+        return false;
+    }
+    return true;
+}
+}  // namespace lox
@@ -0,0 +1,79 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "engine.hpp"
+#include "environment.hpp"
+#include "expression_ast.hpp"
+#include "program.hpp"
+#include "statement_ast.hpp"
+
+namespace lox
+{
+// Runtime state the compiled closures work on
+struct ClosureContext
+{
+    Environment* environment{nullptr};
+    // Recycled block environments, as in the Interpreter
+    std::vector<std::unique_ptr<Environment>> pool;
+    Output* output{nullptr};
+};
+
+using CompiledExpression = std::function<Value(ClosureContext&)>;
+using CompiledStatement = std::function<void(ClosureContext&)>;
+
+// Turns a resolved tree into nested closures, once per program. All decisions that only depend
+// on the tree (operator, literal operands, variable depth) are taken here, so running the
+// closures never switches on a token type or visits a node.
+class ClosureCompiler : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    // globals is the environment the programs run in, variables resolved to it are bound to it
+    explicit ClosureCompiler(Environment& globals) : m_globals(globals) {}
+
+    std::vector<CompiledStatement> compile(Program& program);
+
+private:
+    CompiledExpression compile(Expression* expression);
+    CompiledStatement compile(Statement* statement);
+    std::vector<CompiledStatement> compile(StatementList& statements);
+
+    void visitStatementBlock(StatementBlock& statement) override;
+    void visitStatementExpression(StatementExpression& statement) override;
+    void visitStatementIf(StatementIf& statement) override;
+    void visitStatementPrint(StatementPrint& statement) override;
+    void visitStatementWhile(StatementWhile& statement) override;
+    void visitStatementVariable(StatementVariable& statement) override;
+
+    void visitExpressionAssign(ExpressionAssign& expression) override;
+    void visitExpressionBinary(ExpressionBinary& expression) override;
+    void visitExpressionLogical(ExpressionLogical& expression) override;
+    void visitExpressionGrouping(ExpressionGrouping& expression) override;
+    void visitExpressionLiteral(ExpressionLiteral& expression) override;
+    void visitExpressionUnary(ExpressionUnary& expression) override;
+    void visitExpressionVariable(ExpressionVariable& expression) override;
+
+    Environment& m_globals;
+    // Scoped blocks around the node being compiled, a variable this deep is a global
+    int m_level{0};
+    // Results of the visit in progress
+    CompiledExpression m_expression;
+    CompiledStatement m_statement;
+};
+
+// Executes programs through the ClosureCompiler, an alternative to the Interpreter and the Vm
+class ClosureEngine : public Engine
+{
+public:
+    explicit ClosureEngine(Output& output = Output::standard());
+
+    bool interpret(Program& program) override;
+    [[nodiscard]] int definedGlobals() const override { return m_global_environment->size(); }
+
+private:
+    std::unique_ptr<Environment> m_global_environment;
+    ClosureCompiler m_compiler;
+    ClosureContext m_context;
+};
+}  // namespace lox
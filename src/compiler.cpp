@@ -0,0 +1,469 @@
+#include "compiler.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cassert>
+#include <optional>
+#include <string>
+
+namespace lox
+{
+namespace
+{
+constexpr int Short_Operand_Max = 0xffff;
+constexpr int Long_Operand_Max = 0xffffff;
+
+std::optional<OpCode> longForm(OpCode op)
+{
+    switch (op)
+    {
+    case OpCode::Constant:
+        return OpCode::ConstantLong;
+    case OpCode::GetGlobal:
+        return OpCode::GetGlobalLong;
+    case OpCode::DefineGlobal:
+        return OpCode::DefineGlobalLong;
+    case OpCode::SetGlobal:
+        return OpCode::SetGlobalLong;
+    case OpCode::Undefined:
+        return OpCode::UndefinedLong;
+    case OpCode::Jump:
+        return OpCode::JumpLong;
+    case OpCode::JumpIfFalse:
+        return OpCode::JumpIfFalseLong;
+    case OpCode::Loop:
+        return OpCode::LoopLong;
+    default:
+        return std::nullopt;
+    }
+}
+}  // namespace
+
+Chunk Compiler::compile(Program& program)
+{
+    m_long_jumps = false;
+    compileProgram(program);
+    if (m_jump_overflow)
+    {
+        m_long_jumps = true;
+        compileProgram(program);
+    }
+
+    m_chunk.setMaxStack(m_max_stack);
+    m_chunk.setGlobalCount(m_global_count);
+    if (spdlog::should_log(spdlog::level::debug))
+    {
+        m_chunk.disassemble("program");
+    }
+    return std::move(m_chunk);
+}
+
+void Compiler::compileProgram(Program& program)
+{
+    m_chunk = Chunk();
+    m_scopes.clear();
+    m_stack_depth = 0;
+    m_max_stack = 0;
+    m_global_count = 0;
+    m_jump_overflow = false;
+
+    for (auto& statement : program.statements())
+    {
+        compile(rawNode(statement));
+    }
+    emit(OpCode::Return, 0);
+}
+
+void Compiler::compile(Statement* statement)
+{
+    if (statement != nullptr)
+    {
+        statement->accept(*this);
+    }
+}
+
+void Compiler::compile(Expression* expression)
+{
+    if (expression != nullptr)
+    {
+        expression->accept(*this);
+    }
+    else
+    {
+        // Matches the interpreter, which evaluates a missing expression to nil
+        emit(OpCode::Nil, 1);
+    }
+}
+
+void Compiler::emit(OpCode op, int stack_effect)
+{
+    m_chunk.write(op, m_line);
+    m_stack_depth += stack_effect;
+    assert(m_stack_depth >= 0);
+    if (m_stack_depth > m_max_stack)
+    {
+        m_max_stack = m_stack_depth;
+    }
+}
+
+void Compiler::emit(OpCode op, int stack_effect, int operand)
+{
+    if (operand >= 0 && operand <= Short_Operand_Max)
+    {
+        emit(op, stack_effect);
+        m_chunk.writeShort(static_cast<std::uint16_t>(operand), m_line);
+        return;
+    }
+    auto long_op = longForm(op);
+    if (!long_op || operand < 0 || operand > Long_Operand_Max)
+    {
+        throw CompileError(m_line, "Program too large for bytecode operand " +
+                                       std::to_string(operand) + ".");
+    }
+    emit(*long_op, stack_effect);
+    m_chunk.writeLong(static_cast<std::uint32_t>(operand), m_line);
+}
+
+std::size_t Compiler::emitJump(OpCode op)
+{
+    // The placeholder offset picks the form
+    emit(op, 0, m_long_jumps ? Long_Operand_Max : 0);
+    return m_chunk.code().size() - (m_long_jumps ? 3 : 2);
+}
+
+void Compiler::patchJump(std::size_t offset)
+{
+    // Jump from just after the operand to the current end of the code
+    auto distance = static_cast<int>(m_chunk.code().size() - offset) - (m_long_jumps ? 3 : 2);
+    if (!m_long_jumps && distance > Short_Operand_Max)
+    {
+        m_jump_overflow = true;
+        return;
+    }
+    if (distance > Long_Operand_Max)
+    {
+        throw CompileError(m_line, "Program too large for bytecode operand " +
+                                       std::to_string(distance) + ".");
+    }
+    if (m_long_jumps)
+    {
+        m_chunk.patchLong(offset, static_cast<std::uint32_t>(distance));
+    }
+    else
+    {
+        m_chunk.patchShort(offset, static_cast<std::uint16_t>(distance));
+    }
+}
+
+void Compiler::emitLoop(std::size_t loop_start)
+{
+    // The offset also skips over the Loop instruction itself, one byte longer in the long form
+    auto distance = static_cast<int>(m_chunk.code().size() - loop_start) + 3;
+    if (distance > Short_Operand_Max)
+    {
+        distance++;
+    }
+    emit(OpCode::Loop, 0, distance);
+}
+
+void Compiler::emitConstant(Value value)
+{
+    auto index = m_chunk.addConstant(std::move(value));
+    emit(OpCode::Constant, 1, static_cast<int>(index));
+}
+
+int Compiler::localIndex(int depth, int slot) const
+{
+    auto scopes = static_cast<int>(m_scopes.size());
+    if (depth >= scopes)
+    {
+        return -1;
+    }
+    return m_scopes[scopes - 1 - depth].base + slot;
+}
+
+void Compiler::useGlobal(int slot)
+{
+    if (slot >= m_global_count)
+    {
+        m_global_count = slot + 1;
+    }
+}
+
+void Compiler::emitGet(const Token& name, int depth, int slot)
+{
+    if (depth < 0)
+    {
+        emitUndefined(name, 1);
+        return;
+    }
+    auto index = localIndex(depth, slot);
+    if (index < 0)
+    {
+        useGlobal(slot);
+        emit(OpCode::GetGlobal, 1, slot);
+    }
+    else
+    {
+        emit(OpCode::GetLocal, 1, index);
+    }
+}
+
+void Compiler::emitSet(const Token& name, int depth, int slot)
+{
+    if (depth < 0)
+    {
+        emitUndefined(name, 0);
+        return;
+    }
+    auto index = localIndex(depth, slot);
+    if (index < 0)
+    {
+        useGlobal(slot);
+        emit(OpCode::SetGlobal, 0, slot);
+    }
+    else
+    {
+        emit(OpCode::SetLocal, 0, index);
+    }
+}
+
+void Compiler::emitUndefined(const Token& name, int stack_effect)
+{
+    auto index = m_chunk.addConstant(Value::intern(name.lexeme()));
+    emit(OpCode::Undefined, stack_effect, static_cast<int>(index));
+}
+
+void Compiler::visitStatementBlock(StatementBlock& statement)
+{
+    auto* statements = statement.getStatements();
+    if (!statement.getScoped())
+    {
+        // Nothing is declared, the resolver gave this block no scope of its own
+        if (statements != nullptr)
+        {
+            for (auto& inner : *statements)
+            {
+                compile(rawNode(inner));
+            }
+        }
+        return;
+    }
+
+    m_scopes.push_back(Scope{m_stack_depth, 0});
+    if (statements != nullptr)
+    {
+        for (auto& inner : *statements)
+        {
+            compile(rawNode(inner));
+        }
+    }
+    auto count = m_scopes.back().count;
+    m_scopes.pop_back();
+    if (count > 0)
+    {
+        emit(OpCode::PopN, -count, count);
+    }
+}
+
+void Compiler::visitStatementExpression(StatementExpression& statement)
+{
+    compile(statement.getExpression());
+    emit(OpCode::Pop, -1);
+}
+
+void Compiler::visitStatementIf(StatementIf& statement)
+{
+    compile(statement.getCondition());
+    auto then_jump = emitJump(OpCode::JumpIfFalse);
+    emit(OpCode::Pop, -1);
+    compile(statement.getthenBranch());
+    auto else_jump = emitJump(OpCode::Jump);
+
+    patchJump(then_jump);
+    // The condition is still on the stack when the then branch is skipped
+    m_stack_depth++;
+    emit(OpCode::Pop, -1);
+    compile(statement.getelseBranch());
+    patchJump(else_jump);
+}
+
+void Compiler::visitStatementPrint(StatementPrint& statement)
+{
+    compile(statement.getExpression());
+    emit(OpCode::Print, -1);
+}
+
+void Compiler::visitStatementWhile(StatementWhile& statement)
+{
+    auto loop_start = m_chunk.code().size();
+    compile(statement.getCondition());
+    auto exit_jump = emitJump(OpCode::JumpIfFalse);
+    emit(OpCode::Pop, -1);
+    compile(statement.getBody());
+    emitLoop(loop_start);
+
+    patchJump(exit_jump);
+    m_stack_depth++;
+    emit(OpCode::Pop, -1);
+}
+
+void Compiler::visitStatementVariable(StatementVariable& statement)
+{
+    m_line = statement.getName().line();
+    compile(statement.getInitializer());
+
+    auto slot = statement.getSlot();
+    if (m_scopes.empty())
+    {
+        useGlobal(slot);
+        emit(OpCode::DefineGlobal, -1, slot);
+        return;
+    }
+
+    auto& scope = m_scopes.back();
+    if (slot == scope.count)
+    {
+        // The initializer value stays on the stack as the new local
+        assert(scope.base + slot == m_stack_depth - 1);
+        scope.count++;
+    }
+    else
+    {
+        emit(OpCode::SetLocal, 0, scope.base + slot);
+        emit(OpCode::Pop, -1);
+    }
+}
+
+void Compiler::visitExpressionAssign(ExpressionAssign& expression)
+{
+    compile(expression.getValue());
+    m_line = expression.getName().line();
+    emitSet(expression.getName(), expression.getDepth(), expression.getSlot());
+}
+
+void Compiler::visitExpressionBinary(ExpressionBinary& expression)
+{
+    compile(expression.getLeft());
+    compile(expression.getRight());
+    m_line = expression.getToken().line();
+
+    switch (expression.getToken().type())
+    {
+    case TokenType::MINUS:
+        emit(OpCode::Subtract, -1);
+        break;
+    case TokenType::SLASH:
+        emit(OpCode::Divide, -1);
+        break;
+    case TokenType::STAR:
+        emit(OpCode::Multiply, -1);
+        break;
+    case TokenType::PLUS:
+        emit(OpCode::Add, -1);
+        break;
+    case TokenType::GREATER:
+        emit(OpCode::Greater, -1);
+        break;
+    case TokenType::GREATER_EQUAL:
+        emit(OpCode::GreaterEqual, -1);
+        break;
+    case TokenType::LESS:
+        emit(OpCode::Less, -1);
+        break;
+    case TokenType::LESS_EQUAL:
+        emit(OpCode::LessEqual, -1);
+        break;
+    case TokenType::BANG_EQUAL:
+        emit(OpCode::NotEqual, -1);
+        break;
+    case TokenType::EQUAL_EQUAL:
+        emit(OpCode::Equal, -1);
+        break;
+    default:
+        throw CompileError(m_line,
+                           "Unrecognized binary operator " +
+                               std::string(expression.getToken().lexeme()));
+    }
+}
+
+void Compiler::visitExpressionLogical(ExpressionLogical& expression)
+{
+    compile(expression.getLeft());
+    m_line = expression.getToken().line();
+
+    switch (expression.getToken().type())
+    {
+    case TokenType::OR:
+    {
+        auto else_jump = emitJump(OpCode::JumpIfFalse);
+        auto end_jump = emitJump(OpCode::Jump);
+        patchJump(else_jump);
+        emit(OpCode::Pop, -1);
+        compile(expression.getRight());
+        patchJump(end_jump);
+        break;
+    }
+    case TokenType::AND:
+    {
+        auto end_jump = emitJump(OpCode::JumpIfFalse);
+        emit(OpCode::Pop, -1);
+        compile(expression.getRight());
+        patchJump(end_jump);
+        break;
+    }
+    default:
+        throw CompileError(m_line,
+                           "Unrecognized logical operator " +
+                               std::string(expression.getToken().lexeme()));
+    }
+}
+
+void Compiler::visitExpressionGrouping(ExpressionGrouping& expression)
+{
+    compile(expression.getExpression());
+}
+
+void Compiler::visitExpressionLiteral(ExpressionLiteral& expression)
+{
+    const auto& value = expression.getValue();
+    switch (value.type())
+    {
+    case ValueType::Nil:
+        emit(OpCode::Nil, 1);
+        break;
+    case ValueType::Bool:
+        emit(value.asBool() ? OpCode::True : OpCode::False, 1);
+        break;
+    default:
+        emitConstant(value);
+        break;
+    }
+}
+
+void Compiler::visitExpressionUnary(ExpressionUnary& expression)
+{
+    compile(expression.getExpression());
+    m_line = expression.getToken().line();
+
+    switch (expression.getToken().type())
+    {
+    case TokenType::MINUS:
+        emit(OpCode::Negate, 0);
+        break;
+    case TokenType::BANG:
+        emit(OpCode::Not, 0);
+        break;
+    default:
+        throw CompileError(m_line,
+                           "Unrecognized unary operator " +
+                               std::string(expression.getToken().lexeme()));
+    }
+}
+
+void Compiler::visitExpressionVariable(ExpressionVariable& expression)
+{
+    m_line = expression.getName().line();
+    emitGet(expression.getName(), expression.getDepth(), expression.getSlot());
+}
+}  // namespace lox
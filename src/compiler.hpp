@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "chunk.hpp"
+#include "exception.hpp"
+#include "expression_ast.hpp"
+#include "program.hpp"
+#include "statement_ast.hpp"
+
+namespace lox
+{
+// Compiles a resolved program into a Chunk for the Vm.
+// Globals keep the slots assigned by the Resolver, block locals live on the value stack and
+// their (depth, slot) annotation is turned into an absolute stack index.
+class Compiler : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    // Throws CompileError if the program does not fit the bytecode limits
+    Chunk compile(Program& program);
+
+private:
+    struct Scope
+    {
+        // Stack index of the first local of this block
+        int base;
+        // Locals declared so far, also the number to pop when the block ends
+        int count;
+    };
+
+    // One pass over the program into a fresh chunk
+    void compileProgram(Program& program);
+    void compile(Statement* statement);
+    void compile(Expression* expression);
+
+    // stack_effect is the change in value stack depth caused by the instruction
+    void emit(OpCode op, int stack_effect);
+    // Switches to the long form of op if operand does not fit in 16 bits
+    void emit(OpCode op, int stack_effect, int operand);
+    // Emits a jump with a placeholder offset, returns the offset to patch
+    std::size_t emitJump(OpCode op);
+    void patchJump(std::size_t offset);
+    void emitLoop(std::size_t loop_start);
+    void emitConstant(Value value);
+
+    void emitGet(const Token& name, int depth, int slot);
+    void emitSet(const Token& name, int depth, int slot);
+    // Reports an unresolved variable when executed
+    void emitUndefined(const Token& name, int stack_effect);
+    // Turns a resolved local into its stack index, returns -1 for globals
+    [[nodiscard]] int localIndex(int depth, int slot) const;
+    void useGlobal(int slot);
+
+    void visitStatementBlock(StatementBlock& statement) override;
+    void visitStatementExpression(StatementExpression& statement) override;
+    void visitStatementIf(StatementIf& statement) override;
+    void visitStatementPrint(StatementPrint& statement) override;
+    void visitStatementWhile(StatementWhile& statement) override;
+    void visitStatementVariable(StatementVariable& statement) override;
+
+    void visitExpressionAssign(ExpressionAssign& expression) override;
+    void visitExpressionBinary(ExpressionBinary& expression) override;
+    void visitExpressionLogical(ExpressionLogical& expression) override;
+    void visitExpressionGrouping(ExpressionGrouping& expression) override;
+    void visitExpressionLiteral(ExpressionLiteral& expression) override;
+    void visitExpressionUnary(ExpressionUnary& expression) override;
+    void visitExpressionVariable(ExpressionVariable& expression) override;
+
+    Chunk m_chunk;
+    std::vector<Scope> m_scopes;
+    int m_line{0};
+    int m_stack_depth{0};
+    int m_max_stack{0};
+    int m_global_count{0};
+    // Forward jumps are emitted before their target is known, so they are all short until one
+    // does not fit and the program is compiled again with long ones
+    bool m_long_jumps{false};
+    bool m_jump_overflow{false};
+};
+}  // namespace lox
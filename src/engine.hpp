@@ -0,0 +1,28 @@
+#pragma once
+#include "output.hpp"
+#include "program.hpp"
+
+namespace lox
+{
+// Common entry point for the execution backends so Application can pick one at startup
+class Engine
+{
+public:
+    explicit Engine(Output& output = Output::standard()) : m_output(output) {}
+    Engine(const Engine&) = delete;
+    Engine& operator=(const Engine&) = delete;
+    virtual ~Engine() = default;
+
+    // Runs an already resolved program, reporting runtime errors itself.
+    // Returns false if execution stopped on an error.
+    virtual bool interpret(Program& program) = 0;
+
+    // Global slots below this one have been defined. Slots are defined in the order the
+    // Resolver hands them out, so after a failed run the ones from here on never were.
+    [[nodiscard]] virtual int definedGlobals() const = 0;
+
+protected:
+    // Where print statements go. Flushed before runtime errors are logged so both stay in order.
+    Output& m_output;
+};
+}  // namespace lox
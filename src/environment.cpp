@@ -1,55 +1,70 @@
 #include "environment.hpp"
 
-#include <spdlog/spdlog.h>
-
+#include <cassert>
 #include <utility>
 
-#include "interpreter.hpp"
+#include "trace.hpp"
 
 namespace lox
 {
-void Environment::define(std::string name, std::unique_ptr<LiteralVal> value)
+void Environment::define(int slot, Value value)
 {
-    spdlog::debug("Defining variable {} with value {}", name, value->repr());
-    m_values.emplace(std::move(name), std::move(value));
+    LOX_DEBUG("Defining slot {} with value {}", slot, value.repr());
+    store(slot, std::move(value));
 }
 
-void Environment::assign(const Token &token, std::unique_ptr<LiteralVal> value)
+void Environment::assign(int depth, int slot, Value value)
 {
-    spdlog::debug("Assigning variable {} value {}", token.repr(), value->repr());
-    try
+    LOX_DEBUG("Assigning depth {} slot {} value {}", depth, slot, value.repr());
+    Stats::countLookup(depth);
+    ancestor(depth).store(slot, std::move(value));
+}
+
+const Value &Environment::get(int depth, int slot) const
+{
+    LOX_DEBUG("Reading depth {} slot {}", depth, slot);
+    Stats::countLookup(depth);
+    const auto &environment = ancestor(depth);
+    assert(slot >= 0);
+    // Not expected, the Resolver forgets the globals of declarations that failed at runtime.
+    // Read as nil rather than past the end.
+    if (slot >= (int)environment.m_values.size())
     {
-        auto &result = m_values.at(token.lexeme());
-        result = std::move(value);
+        static const Value nil;
+        return nil;
     }
-    catch (std::out_of_range &e)
+    return environment.m_values[slot];
+}
+
+void Environment::store(int slot, Value value)
+{
+    assert(slot >= 0);
+    if (slot >= (int)m_values.size())
     {
-        if (m_enclosing != nullptr)
-        {
-            m_enclosing->assign(token, std::move(value));
-        }
-        else
-        {
-            throw RuntimeError(token, "Undefined variable " + token.lexeme() + ".");
-        }
+        m_values.resize(slot + 1);
     }
+    m_values[slot] = std::move(value);
 }
 
-LiteralVal Environment::get(const Token &token) const
+Environment &Environment::ancestor(int depth)
 {
-    spdlog::debug("Reading variable {}", token.repr());
-    try
+    auto *environment = this;
+    for (int i = 0; i < depth; i++)
     {
-        const auto &result = m_values.at(token.lexeme());
-        return *result;
+        assert(environment->m_enclosing != nullptr);
+        environment = environment->m_enclosing;
     }
-    catch (std::out_of_range &e)
+    return *environment;
+}
+
+const Environment &Environment::ancestor(int depth) const
+{
+    const auto *environment = this;
+    for (int i = 0; i < depth; i++)
     {
-        if (m_enclosing != nullptr)
-        {
-            return m_enclosing->get(token);
-        }
-        throw RuntimeError(token, "Undefined variable " + token.lexeme() + ".");
+        assert(environment->m_enclosing != nullptr);
+        environment = environment->m_enclosing;
     }
+    return *environment;
 }
 }  // namespace lox
@@ -1,24 +1,41 @@
 #pragma once
 
-#include <map>
-#include <string>
+#include <vector>
 
-#include "literal.hpp"
-#include "token.hpp"
+#include "stats.hpp"
+#include "value.hpp"
 
 namespace lox
 {
+// Variables are addressed by the (depth, slot) pair computed by the Resolver,
+// so a lookup is a walk of `depth` enclosing pointers and an index into a flat array.
 class Environment
 {
 public:
-    explicit Environment(Environment *enclosing = nullptr) : m_enclosing(enclosing) {}
-    void define(std::string name, std::unique_ptr<LiteralVal> value);
-    void assign(const Token &token, std::unique_ptr<LiteralVal> value);
+    explicit Environment(Environment *enclosing = nullptr) : m_enclosing(enclosing)
+    {
+        Stats::countEnvironment();
+    }
 
-    [[nodiscard]] LiteralVal get(const Token &token) const;
+    // Empties the environment for reuse under another enclosing one, keeping its capacity
+    void reset(Environment *enclosing)
+    {
+        m_values.clear();
+        m_enclosing = enclosing;
+    }
+    void define(int slot, Value value);
+    void assign(int depth, int slot, Value value);
+
+    [[nodiscard]] const Value &get(int depth, int slot) const;
+    // One past the highest slot stored in this environment
+    [[nodiscard]] int size() const { return static_cast<int>(m_values.size()); }
 
 private:
-    std::map<std::string, std::unique_ptr<LiteralVal>> m_values;
+    void store(int slot, Value value);
+    [[nodiscard]] Environment &ancestor(int depth);
+    [[nodiscard]] const Environment &ancestor(int depth) const;
+
+    std::vector<Value> m_values;
     Environment *m_enclosing;
 };
 
@@ -36,4 +36,31 @@ public:
 private:
     const std::string m_type;
 };
+
+class IoError : public BaseException
+{
+public:
+    explicit IoError(std::string error_msg) : BaseException(std::move(error_msg)) {}
+};
+
+// A loop the Jit cannot compile, or code it cannot map
+class JitError : public BaseException
+{
+public:
+    explicit JitError(std::string error_msg) : BaseException(std::move(error_msg)) {}
+};
+
+class CompileError : public BaseException
+{
+public:
+    CompileError(int line, std::string error_msg)
+        : BaseException(std::move(error_msg)), m_line(line)
+    {
+    }
+
+    [[nodiscard]] int line() const { return m_line; }
+
+private:
+    const int m_line;
+};
 }  // namespace lox
@@ -2,25 +2,31 @@
 
 #include <spdlog/spdlog.h>
 
-#include <cassert>
+#include <functional>
+
+#include "profiler.hpp"
+#include "trace.hpp"
+
 namespace lox
 {
-std::unique_ptr<LiteralVal> Interpreter::evaluate(Expression* expression)
+Value Interpreter::evaluate(Expression* expression)
 {
     if (expression != nullptr)
     {
         return expression->accept(*this);
     }
-    // TODO: I think this is the right thing to do, not sure though
-    spdlog::error("Evaluating a nullptr expression, wtf?");
-    return nullptr;
+    // The parser only leaves an expression out after reporting an error
+    spdlog::error("Null expression found, evaluating it as nil");
+    return Value();
 }
 
-void Interpreter::interpret(std::vector<std::unique_ptr<Statement>>&& program)
+bool Interpreter::interpret(Program& program)
 {
+    LOX_TRACE_EVENT("interpret", "statements={}", program.statements().size());
+    m_program = &program;
     try
     {
-        for (auto& statement : program)
+        for (auto& statement : program.statements())
         {
             if (statement != nullptr)
             {
@@ -34,14 +40,17 @@ void Interpreter::interpret(std::vector<std::unique_ptr<Statement>>&& program)
     }
     catch (RuntimeError& error)
     {
+        LOX_TRACE_EVENT("runtime_error", "line={}", error.token().line());
+        m_output.flush();
         spdlog::error(error.what());
         spdlog::error("Error found on line {} token {}", error.token().line(),
                       error.token().lexeme());
+        return false;
     }
+    return true;
 }
 
-void Interpreter::executeBlock(std::vector<std::unique_ptr<Statement>>& statements,
-                               Environment& environment)
+void Interpreter::executeBlock(StatementList& statements, Environment& environment)
 {
     auto* previous_env = m_environment;
     try
@@ -66,28 +75,76 @@ void Interpreter::executeBlock(std::vector<std::unique_ptr<Statement>>& statemen
     {
         // Even if exception occurs we need to restore the old env
         m_environment = previous_env;
+        throw;
+    }
+}
+
+std::unique_ptr<Environment> Interpreter::acquireEnvironment(Environment* enclosing)
+{
+    LOX_TRACE_EVENT("environment", "pooled={}", !m_environment_pool.empty());
+    if (m_environment_pool.empty())
+    {
+        return std::make_unique<Environment>(enclosing);
     }
+    auto environment = std::move(m_environment_pool.back());
+    m_environment_pool.pop_back();
+    environment->reset(enclosing);
+    return environment;
+}
+
+void Interpreter::releaseEnvironment(std::unique_ptr<Environment> environment)
+{
+    // Drop the values now rather than on the next use
+    environment->reset(nullptr);
+    m_environment_pool.push_back(std::move(environment));
 }
 
 void Interpreter::visitStatementBlock(StatementBlock& statement)
 {
     auto* statements = statement.getStatements();
-    if (statements != nullptr)
+    if (statements == nullptr)
+    {
+        return;
+    }
+    if (!statement.getScoped())
+    {
+        for (auto& inner : *statements)
+        {
+            if (inner != nullptr)
+            {
+                execute(*inner);
+            }
+            else
+            {
+                spdlog::error("Null statement found in block");
+            }
+        }
+        return;
+    }
+
+    auto environment = acquireEnvironment(m_environment);
+    try
     {
-        Environment env(m_environment);
-        executeBlock(*statements, env);
+        executeBlock(*statements, *environment);
     }
+    catch (RuntimeError& error)
+    {
+        releaseEnvironment(std::move(environment));
+        throw;
+    }
+    releaseEnvironment(std::move(environment));
 }
 
 void Interpreter::visitStatementExpression(StatementExpression& statement)
 {
+    Profiler::statement(statement.getLine());
     (void)evaluate(statement.getExpression());
 }
 
 void Interpreter::visitStatementIf(StatementIf& statement)
 {
-    auto result = evaluate(statement.getCondition());
-    if (result != nullptr && isTruthy(*result))
+    Profiler::Frame frame(statement.getLine());
+    if (evaluate(statement.getCondition()).isTruthy())
     {
         auto* thenbranch = statement.getthenBranch();
         if (thenbranch != nullptr)
@@ -107,13 +164,26 @@ void Interpreter::visitStatementIf(StatementIf& statement)
 
 void Interpreter::visitStatementPrint(StatementPrint& statement)
 {
+    Profiler::statement(statement.getLine());
     auto value = evaluate(statement.getExpression());
-    spdlog::info(value->repr());
+    m_output.line(value.repr());
 }
 
 void Interpreter::visitStatementWhile(StatementWhile& statement)
 {
-    while (isTruthy(*evaluate(statement.getCondition())))
+    Profiler::Frame frame(statement.getLine());
+    const auto& plan = statement.getPlan();
+    LOX_TRACE_EVENT("loop", "counted={} invariants={}", plan.counted, plan.invariants.size());
+    for (auto* invariant : plan.invariants)
+    {
+        invariant->setHoistedValue(m_numbers.compute(*invariant));
+    }
+    if (plan.counted && runCounted(statement, plan))
+    {
+        return;
+    }
+
+    while (evaluate(statement.getCondition()).isTruthy())
     {
         auto* body = statement.getBody();
         if (body != nullptr)
@@ -124,120 +194,333 @@ void Interpreter::visitStatementWhile(StatementWhile& statement)
         {
             spdlog::error("Null body in while statement");
         }
+        if (runNative(statement))
+        {
+            return;
+        }
+        // Back at the condition
+        Profiler::statement(0);
     }
 }
 
+bool Interpreter::runCounted(StatementWhile& statement, const LoopPlan& plan)
+{
+    // Read in the order the condition would
+    const auto& index = m_environment->get(plan.depth, plan.slot);
+    auto limit = evaluate(plan.limit);
+    if (!index.isNumber() || !limit.isNumber())
+    {
+        return false;
+    }
+    switch (plan.comparison)
+    {
+    case TokenType::LESS:
+        runCounted<std::less<>>(statement, plan, index.asNumber(), limit.asNumber());
+        break;
+    case TokenType::LESS_EQUAL:
+        runCounted<std::less_equal<>>(statement, plan, index.asNumber(), limit.asNumber());
+        break;
+    case TokenType::GREATER:
+        runCounted<std::greater<>>(statement, plan, index.asNumber(), limit.asNumber());
+        break;
+    case TokenType::GREATER_EQUAL:
+        runCounted<std::greater_equal<>>(statement, plan, index.asNumber(), limit.asNumber());
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+template <typename Compare>
+void Interpreter::runCounted(StatementWhile& statement, const LoopPlan& plan, double index,
+                             double limit)
+{
+    // The increment is the last statement of the body, it is done here on the double
+    auto& statements = *static_cast<StatementBlock*>(statement.getBody())->getStatements();
+    auto body_size = statements.size() - 1;
+    Compare compare;
+    while (compare(index, limit))
+    {
+        for (std::size_t i = 0; i < body_size; i++)
+        {
+            if (statements[i] != nullptr)
+            {
+                execute(*statements[i]);
+            }
+            else
+            {
+                spdlog::error("Null statement found in block");
+            }
+        }
+        Profiler::statement(0);
+        index += plan.step;
+        m_environment->assign(plan.depth, plan.slot, Value(index));
+        if (runNative(statement))
+        {
+            return;
+        }
+    }
+}
+
+bool Interpreter::runNative(StatementWhile& statement)
+{
+    if constexpr (!Jit::Enabled)
+    {
+        return false;
+    }
+    if (Profiler::running())
+    {
+        return false;
+    }
+    auto* native = statement.getNative();
+    if (native == nullptr)
+    {
+        auto hotness = statement.getHotness();
+        if (hotness < 0)
+        {
+            return false;
+        }
+        if (++hotness < Jit::Hot_Loop_Iterations)
+        {
+            statement.setHotness(hotness);
+            return false;
+        }
+        native = Jit::compile(statement, m_program->arena());
+        LOX_TRACE_EVENT("jit", "compiled={}", native != nullptr);
+        if (native == nullptr)
+        {
+            statement.setHotness(-1);
+            return false;
+        }
+        statement.setNative(native);
+    }
+    if (native->run(*m_environment))
+    {
+        return true;
+    }
+    if (native->guardFailures() >= Jit::Max_Guard_Failures)
+    {
+        LOX_TRACE_EVENT("jit", "dropped guard_failures={}", native->guardFailures());
+        statement.setNative(nullptr);
+        statement.setHotness(-1);
+    }
+    return false;
+}
+
 void Interpreter::visitStatementVariable(StatementVariable& statement)
 {
-    std::unique_ptr<LiteralVal> value;
-    assert(statement.getName() != nullptr);
+    Profiler::statement(statement.getName().line());
+    Value value;
     if (statement.getInitializer() != nullptr)
     {
         value = evaluate(statement.getInitializer());
     }
 
-    m_environment->define(statement.getName().lexeme(), std::move(value));
+    m_environment->define(statement.getSlot(), std::move(value));
 }
 
-[[nodiscard]] std::unique_ptr<LiteralVal> Interpreter::visitExpressionAssign(
-    ExpressionAssign& expression)
+Value Interpreter::visitExpressionAssign(ExpressionAssign& expression)
 {
     auto value = evaluate(expression.getValue());
+    if (expression.getDepth() < 0)
+    {
+        throw RuntimeError(expression.getName(),
+                           "Undefined variable " + std::string(expression.getName().lexeme()) +
+                               ".");
+    }
 
-    // Make a new copy of value here so that we can return the original
-    m_environment->assign(expression.getName(), std::make_unique<LiteralVal>(*value));
+    // Store a copy of value here so that we can return the original
+    m_environment->assign(expression.getDepth(), expression.getSlot(), value);
     return value;
 }
 
-std::unique_ptr<LiteralVal> Interpreter::visitExpressionBinary(ExpressionBinary& expression)
+namespace
 {
-    auto right = evaluate(expression.getRight());
-    auto left = evaluate(expression.getLeft());
-
-    switch (expression.getToken().type())
+// Specialization for a node whose operands were both numbers, Generic if there is none
+BinaryFeedback numberFeedback(TokenType type)
+{
+    switch (type)
     {
+    case TokenType::PLUS:
+        return BinaryFeedback::NumberAdd;
     case TokenType::MINUS:
+        return BinaryFeedback::NumberSubtract;
+    case TokenType::STAR:
+        return BinaryFeedback::NumberMultiply;
+    case TokenType::SLASH:
+        return BinaryFeedback::NumberDivide;
+    case TokenType::GREATER:
+        return BinaryFeedback::NumberGreater;
+    case TokenType::GREATER_EQUAL:
+        return BinaryFeedback::NumberGreaterEqual;
+    case TokenType::LESS:
+        return BinaryFeedback::NumberLess;
+    case TokenType::LESS_EQUAL:
+        return BinaryFeedback::NumberLessEqual;
+    default:
+        return BinaryFeedback::Generic;
+    }
+}
+}  // namespace
+
+Value Interpreter::visitExpressionBinary(ExpressionBinary& expression)
+{
+    if (expression.getUnboxed())
     {
-        checkNumberOperands(expression.getToken(), *left, *right);
-        auto result = getLiteral<double>(*left) - getLiteral<double>(*right);
-        return std::make_unique<LiteralVal>(result);
+        if (expression.getHoisted())
+        {
+            return Value(expression.getHoistedValue());
+        }
+        auto left = m_numbers.evaluate(expression.getLeft());
+        auto right = m_numbers.evaluate(expression.getRight());
+        return binaryUnboxed(expression.getToken(), left, right);
     }
-    case TokenType::SLASH:
+
+    auto left = evaluate(expression.getLeft());
+    auto right = evaluate(expression.getRight());
+    bool numbers = left.isNumber() && right.isNumber();
+
+    switch (expression.getFeedback())
     {
-        checkNumberOperands(expression.getToken(), *left, *right);
-        auto result = getLiteral<double>(*left) / getLiteral<double>(*right);
-        return std::make_unique<LiteralVal>(result);
+    case BinaryFeedback::Generic:
+        break;
+    case BinaryFeedback::Unseen:
+        expression.setFeedback(numbers ? numberFeedback(expression.getToken().type())
+                                       : BinaryFeedback::Generic);
+        break;
+    default:
+        if (numbers)
+        {
+            return binaryNumbers(expression.getFeedback(), left.asNumber(), right.asNumber());
+        }
+        LOX_DEBUG("Deoptimizing binary {} on line {}", expression.getToken().lexeme(),
+                  expression.getToken().line());
+        LOX_TRACE_EVENT("deopt", "line={} operator={}", expression.getToken().line(),
+                        expression.getToken().lexeme());
+        expression.setFeedback(BinaryFeedback::Generic);
+        break;
     }
-    case TokenType::STAR:
+    return binaryGeneric(expression.getToken(), left, right);
+}
+
+Value Interpreter::binaryNumbers(BinaryFeedback feedback, double left, double right)
+{
+    switch (feedback)
     {
-        checkNumberOperands(expression.getToken(), *left, *right);
-        auto result = getLiteral<double>(*left) * getLiteral<double>(*right);
-        return std::make_unique<LiteralVal>(result);
+    case BinaryFeedback::NumberAdd:
+        return Value(left + right);
+    case BinaryFeedback::NumberSubtract:
+        return Value(left - right);
+    case BinaryFeedback::NumberMultiply:
+        return Value(left * right);
+    case BinaryFeedback::NumberDivide:
+        return Value(left / right);
+    case BinaryFeedback::NumberGreater:
+        return Value(left > right);
+    case BinaryFeedback::NumberGreaterEqual:
+        return Value(left >= right);
+    case BinaryFeedback::NumberLess:
+        return Value(left < right);
+    case BinaryFeedback::NumberLessEqual:
+        return Value(left <= right);
+    default:
+        break;
     }
+    spdlog::error("Binary feedback {} is not a number operation", static_cast<int>(feedback));
+    return Value();
+}
+
+Value Interpreter::binaryUnboxed(const Token& token, double left, double right)
+{
+    switch (token.type())
+    {
+    case TokenType::MINUS:
+        return Value(left - right);
+    case TokenType::SLASH:
+        return Value(left / right);
+    case TokenType::STAR:
+        return Value(left * right);
     case TokenType::PLUS:
+        return Value(left + right);
+    case TokenType::GREATER:
+        return Value(left > right);
+    case TokenType::GREATER_EQUAL:
+        return Value(left >= right);
+    case TokenType::LESS:
+        return Value(left < right);
+    case TokenType::LESS_EQUAL:
+        return Value(left <= right);
+    case TokenType::BANG_EQUAL:
+        return Value(left != right);
+    case TokenType::EQUAL_EQUAL:
+        return Value(left == right);
+    default:
+        spdlog::error("Unrecognized binary operator {}", token.repr());
+        break;
+    }
+    return Value();
+}
+
+Value Interpreter::binaryGeneric(const Token& token, const Value& left, const Value& right)
+{
+    switch (token.type())
     {
-        if (left->type() == LiteralValType::Number && right->type() == LiteralValType::Number)
+    case TokenType::MINUS:
+        checkNumberOperands(token, left, right);
+        return Value(left.asNumber() - right.asNumber());
+    case TokenType::SLASH:
+        checkNumberOperands(token, left, right);
+        return Value(left.asNumber() / right.asNumber());
+    case TokenType::STAR:
+        checkNumberOperands(token, left, right);
+        return Value(left.asNumber() * right.asNumber());
+    case TokenType::PLUS:
+        if (left.isNumber() && right.isNumber())
         {
-            auto result = getLiteral<double>(*left) + getLiteral<double>(*right);
-            return std::make_unique<LiteralVal>(result);
+            return Value(left.asNumber() + right.asNumber());
         }
-        if (left->type() == LiteralValType::String && right->type() == LiteralValType::String)
+        if (left.isString() && right.isString())
         {
-            auto result = getLiteral<std::string>(*left) + getLiteral<std::string>(*right);
-            return std::make_unique<LiteralVal>(result);
+            return Value::concatenate(left, right);
         }
-        throw(RuntimeError(expression.getToken(), "Operands must be two numbers or two strings."));
-    }
+        throw(RuntimeError(token, "Operands must be two numbers or two strings."));
     case TokenType::GREATER:
-    {
-        checkNumberOperands(expression.getToken(), *left, *right);
-        bool result = (getLiteral<double>(*left) > getLiteral<double>(*right));
-        return std::make_unique<LiteralVal>(result);
-    }
+        checkNumberOperands(token, left, right);
+        return Value(left.asNumber() > right.asNumber());
     case TokenType::GREATER_EQUAL:
-    {
-        checkNumberOperands(expression.getToken(), *left, *right);
-        bool result = (getLiteral<double>(*left) >= getLiteral<double>(*right));
-        return std::make_unique<LiteralVal>(result);
-    }
+        checkNumberOperands(token, left, right);
+        return Value(left.asNumber() >= right.asNumber());
     case TokenType::LESS:
-    {
-        checkNumberOperands(expression.getToken(), *left, *right);
-        bool result = (getLiteral<double>(*left) < getLiteral<double>(*right));
-        return std::make_unique<LiteralVal>(result);
-    }
+        checkNumberOperands(token, left, right);
+        return Value(left.asNumber() < right.asNumber());
     case TokenType::LESS_EQUAL:
-    {
-        checkNumberOperands(expression.getToken(), *left, *right);
-        bool result = (getLiteral<double>(*left) <= getLiteral<double>(*right));
-        return std::make_unique<LiteralVal>(result);
-    }
+        checkNumberOperands(token, left, right);
+        return Value(left.asNumber() <= right.asNumber());
     case TokenType::BANG_EQUAL:
-    {
-        return std::make_unique<LiteralVal>(*left == *right);
-    }
+        return Value(left != right);
     case TokenType::EQUAL_EQUAL:
-        return std::make_unique<LiteralVal>(*left != *right);
+        return Value(left == right);
     default:
-        spdlog::error("Unrecognized binary operator {}", expression.getToken().repr());
+        spdlog::error("Unrecognized binary operator {}", token.repr());
         break;
     }
-    return nullptr;
+    return Value();
 }
 
-std::unique_ptr<LiteralVal> Interpreter::visitExpressionLogical(ExpressionLogical& expression)
+Value Interpreter::visitExpressionLogical(ExpressionLogical& expression)
 {
     auto left = evaluate(expression.getLeft());
     switch (expression.getToken().type())
     {
     case TokenType::OR:
-        if (isTruthy(*left))
+        if (left.isTruthy())
         {
             return left;
         }
         break;
     case TokenType::AND:
-        if (!isTruthy(*left))
+        if (!left.isTruthy())
         {
             return left;
         }
@@ -249,73 +532,127 @@ std::unique_ptr<LiteralVal> Interpreter::visitExpressionLogical(ExpressionLogica
     return evaluate(expression.getRight());
 }
 
-std::unique_ptr<LiteralVal> Interpreter::visitExpressionGrouping(ExpressionGrouping& expression)
+Value Interpreter::visitExpressionGrouping(ExpressionGrouping& expression)
 {
     return evaluate(expression.getExpression());
 }
 
-std::unique_ptr<LiteralVal> Interpreter::visitExpressionLiteral(ExpressionLiteral& expression)
+Value Interpreter::visitExpressionLiteral(ExpressionLiteral& expression)
 {
-    // TODO : Check against nullptr. Not sure what to do if we see one at the moment
-    return std::make_unique<LiteralVal>(expression.getValue());
+    return expression.getValue();
 }
 
-std::unique_ptr<LiteralVal> Interpreter::visitExpressionUnary(ExpressionUnary& expression)
+Value Interpreter::visitExpressionUnary(ExpressionUnary& expression)
 {
+    if (expression.getUnboxed())
+    {
+        return Value(-m_numbers.evaluate(expression.getExpression()));
+    }
+
     auto right = evaluate(expression.getExpression());
 
     switch (expression.getToken().type())
     {
     case TokenType::MINUS:
-        checkNumberOperand(expression.getToken(), *right);
-        return std::make_unique<LiteralVal>(-(getLiteral<double>(*right)));
+        checkNumberOperand(expression.getToken(), right);
+        return Value(-right.asNumber());
     case TokenType::BANG:
-        return std::make_unique<LiteralVal>(isTruthy(*right));
+        return Value(!right.isTruthy());
     default:
         break;
     }
 
-    return nullptr;
+    return Value();
 }
 
-std::unique_ptr<LiteralVal> Interpreter::visitExpressionVariable(ExpressionVariable& expression)
+Value Interpreter::visitExpressionVariable(ExpressionVariable& expression)
 {
-    const auto& varname = expression.getName();
-    spdlog::debug("Reading variable {}", varname.lexeme());
-    auto val = m_environment->get(varname);
-    return std::make_unique<LiteralVal>(val);
+    if (expression.getDepth() < 0)
+    {
+        throw RuntimeError(expression.getName(),
+                           "Undefined variable " + std::string(expression.getName().lexeme()) +
+                               ".");
+    }
+    return m_environment->get(expression.getDepth(), expression.getSlot());
 }
-bool Interpreter::isTruthy(const LiteralVal& lval)
+void Interpreter::checkNumberOperand(const Token& token, const Value& operand)
 {
-    bool result = true;
-    if (lval.type() == LiteralValType::Nil)
+    if (operand.isNumber())
     {
-        result = false;
+        return;
     }
-    if (lval.type() == LiteralValType::Bool)
+    throw RuntimeError(token, "Operand must be a number.");
+}
+
+void Interpreter::checkNumberOperands(const Token& token, const Value& left, const Value& right)
+{
+    if (left.isNumber() && right.isNumber())
     {
-        result = getLiteral<bool>(lval);
+        return;
     }
-    return result;
+    throw RuntimeError(token, "Operands must be a number.");
 }
 
-void Interpreter::checkNumberOperand(const Token& token, const LiteralVal& operand)
+double NumberEvaluator::visitExpressionAssign(ExpressionAssign& expression)
 {
-    if (operand.type() == LiteralValType::Number)
+    auto value = evaluate(expression.getValue());
+    m_environment->assign(expression.getDepth(), expression.getSlot(), Value(value));
+    return value;
+}
+
+double NumberEvaluator::visitExpressionBinary(ExpressionBinary& expression)
+{
+    if (expression.getHoisted())
     {
-        return;
+        return expression.getHoistedValue();
     }
-    throw RuntimeError(token, "Operand must be a number.");
+    return compute(expression);
 }
 
-void Interpreter::checkNumberOperands(const Token& token, const LiteralVal& left,
-                                      const LiteralVal& right)
+double NumberEvaluator::compute(ExpressionBinary& expression)
 {
-    if (left.type() == LiteralValType::Number && right.type() == LiteralValType::Number)
+    auto left = evaluate(expression.getLeft());
+    auto right = evaluate(expression.getRight());
+    switch (expression.getToken().type())
     {
-        return;
+    case TokenType::MINUS:
+        return left - right;
+    case TokenType::SLASH:
+        return left / right;
+    case TokenType::STAR:
+        return left * right;
+    case TokenType::PLUS:
+        return left + right;
+    default:
+        break;
     }
-    throw RuntimeError(token, "Operands must be a number.");
+    spdlog::error("Binary {} does not produce a number", expression.getToken().repr());
+    return 0;
+}
+
+double NumberEvaluator::visitExpressionLogical(ExpressionLogical& expression)
+{
+    spdlog::error("Logical {} is never unboxed", expression.getToken().repr());
+    return 0;
 }
 
+double NumberEvaluator::visitExpressionGrouping(ExpressionGrouping& expression)
+{
+    return evaluate(expression.getExpression());
+}
+
+double NumberEvaluator::visitExpressionLiteral(ExpressionLiteral& expression)
+{
+    return expression.getValue().asNumber();
+}
+
+double NumberEvaluator::visitExpressionUnary(ExpressionUnary& expression)
+{
+    return -evaluate(expression.getExpression());
+}
+
+double NumberEvaluator::visitExpressionVariable(ExpressionVariable& expression)
+{
+    return m_environment->get(expression.getDepth(), expression.getSlot()).asNumber();
+}
 }  // namespace lox
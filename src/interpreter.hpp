@@ -1,9 +1,13 @@
 #pragma once
+#include <memory>
 #include <utility>
+#include <vector>
 
+#include "engine.hpp"
 #include "environment.hpp"
 #include "exception.hpp"
 #include "expression_ast.hpp"
+#include "jit.hpp"
 #include "statement_ast.hpp"
 namespace lox
 {
@@ -22,24 +26,61 @@ private:
     const Token m_token;
 };
 
-// TODO: Use string for now, need some kind of lox data object type
-class Interpreter : public ExpressionVisitorLiteralVal, public StatementVisitorVoid
+// Evaluates expressions TypeInference proved to be numbers on raw doubles, without the type
+// checks and Value boxing of the Interpreter. Only reached through Unboxed nodes.
+class NumberEvaluator : public ExpressionVisitorNumber
 {
 public:
-    Interpreter()
-        : m_global_environment(std::make_unique<Environment>()),
+    explicit NumberEvaluator(Environment*& environment) : m_environment(environment) {}
+
+    [[nodiscard]] double evaluate(Expression* expression) { return expression->accept(*this); }
+    // Evaluates a binary even when it is Hoisted, to compute the value it stands for
+    [[nodiscard]] double compute(ExpressionBinary& expression);
+
+private:
+    [[nodiscard]] double visitExpressionAssign(ExpressionAssign& expression) override;
+    [[nodiscard]] double visitExpressionBinary(ExpressionBinary& expression) override;
+    [[nodiscard]] double visitExpressionLogical(ExpressionLogical& expression) override;
+    [[nodiscard]] double visitExpressionGrouping(ExpressionGrouping& expression) override;
+    [[nodiscard]] double visitExpressionLiteral(ExpressionLiteral& expression) override;
+    [[nodiscard]] double visitExpressionUnary(ExpressionUnary& expression) override;
+    [[nodiscard]] double visitExpressionVariable(ExpressionVariable& expression) override;
+
+    // The Interpreter's current environment
+    Environment*& m_environment;
+};
+
+class Interpreter : public Engine, public ExpressionVisitorValue, public StatementVisitorVoid
+{
+public:
+    explicit Interpreter(Output& output = Output::standard())
+        : Engine(output),
+          m_global_environment(std::make_unique<Environment>()),
           m_environment(m_global_environment.get())
     {
     }
-    [[nodiscard]] std::unique_ptr<LiteralVal> evaluate(Expression* expression);
+    [[nodiscard]] Value evaluate(Expression* expression);
 
-    void interpret(std::vector<std::unique_ptr<Statement>>&& program);
+    bool interpret(Program& program) override;
+    [[nodiscard]] int definedGlobals() const override { return m_global_environment->size(); }
 
 private:
     // TODO Why do we need to transfer ownership of the environment? Fix this
     void execute(Statement& statement) { statement.accept(*this); }
-    void executeBlock(std::vector<std::unique_ptr<Statement>>& statements,
-                      Environment& environment);
+    void executeBlock(StatementList& statements, Environment& environment);
+
+    // Block environments are recycled so entering a block does not allocate once warm
+    std::unique_ptr<Environment> acquireEnvironment(Environment* enclosing);
+    void releaseEnvironment(std::unique_ptr<Environment> environment);
+
+    // Counts the iterations of a loop and once it is hot finishes it in machine code.
+    // Returns true if the loop ran to completion natively.
+    bool runNative(StatementWhile& statement);
+    // Runs a loop the LoopOptimizer found to be counted. Returns false without running anything
+    // if the index or limit is not a number, leaving the error to the generic loop.
+    bool runCounted(StatementWhile& statement, const LoopPlan& plan);
+    template <typename Compare>
+    void runCounted(StatementWhile& statement, const LoopPlan& plan, double index, double limit);
 
     void visitStatementBlock(StatementBlock& statement) override;
     void visitStatementExpression(StatementExpression& statement) override;
@@ -48,29 +89,29 @@ private:
     void visitStatementWhile(StatementWhile& statement) override;
     void visitStatementVariable(StatementVariable& statement) override;
 
-    [[nodiscard]] std::unique_ptr<LiteralVal> visitExpressionAssign(
-        ExpressionAssign& expression) override;
-    [[nodiscard]] std::unique_ptr<LiteralVal> visitExpressionBinary(
-        ExpressionBinary& expression) override;
-    [[nodiscard]] std::unique_ptr<LiteralVal> visitExpressionLogical(
-        ExpressionLogical& expression) override;
-    [[nodiscard]] std::unique_ptr<LiteralVal> visitExpressionGrouping(
-        ExpressionGrouping& expression) override;
-    [[nodiscard]] std::unique_ptr<LiteralVal> visitExpressionLiteral(
-        ExpressionLiteral& expression) override;
-    [[nodiscard]] std::unique_ptr<LiteralVal> visitExpressionUnary(
-        ExpressionUnary& expression) override;
-    [[nodiscard]] std::unique_ptr<LiteralVal> visitExpressionVariable(
-        ExpressionVariable& expression) override;
-
-    [[nodiscard]] static bool isTruthy(const LiteralVal& lval);
-
-    static void checkNumberOperand(const Token& token, const LiteralVal& operand);
-    static void checkNumberOperands(const Token& token, const LiteralVal& left,
-                                    const LiteralVal& right);
+    [[nodiscard]] Value visitExpressionAssign(ExpressionAssign& expression) override;
+    [[nodiscard]] Value visitExpressionBinary(ExpressionBinary& expression) override;
+    [[nodiscard]] Value visitExpressionLogical(ExpressionLogical& expression) override;
+    [[nodiscard]] Value visitExpressionGrouping(ExpressionGrouping& expression) override;
+    [[nodiscard]] Value visitExpressionLiteral(ExpressionLiteral& expression) override;
+    [[nodiscard]] Value visitExpressionUnary(ExpressionUnary& expression) override;
+    [[nodiscard]] Value visitExpressionVariable(ExpressionVariable& expression) override;
+
+    // The full operator semantics, used until a node is quickened and after it deoptimizes
+    static Value binaryGeneric(const Token& token, const Value& left, const Value& right);
+    static Value binaryNumbers(BinaryFeedback feedback, double left, double right);
+    // Any operator on two proven numbers, for Unboxed nodes
+    static Value binaryUnboxed(const Token& token, double left, double right);
+
+    static void checkNumberOperand(const Token& token, const Value& operand);
+    static void checkNumberOperands(const Token& token, const Value& left, const Value& right);
 
     std::unique_ptr<Environment> m_global_environment;
     Environment* m_environment;
+    std::vector<std::unique_ptr<Environment>> m_environment_pool;
+    // The program being interpreted, its arena owns the loops the Jit compiles
+    Program* m_program{nullptr};
+    NumberEvaluator m_numbers{m_environment};
 };
 
 }  // namespace lox
@@ -0,0 +1,599 @@
+#include "jit.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cstring>
+#include <map>
+#include <utility>
+
+#include "exception.hpp"
+#include "expression_ast.hpp"
+#include "statement_ast.hpp"
+#include "trace.hpp"
+
+#if LOX_JIT_X86
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#endif
+
+namespace lox
+{
+#if LOX_JIT_X86
+namespace
+{
+// Condition codes of the jcc instructions used after ucomisd
+enum class Condition : std::uint8_t
+{
+    Below = 0x2,
+    AboveEqual = 0x3,
+    Equal = 0x4,
+    NotEqual = 0x5,
+    BelowEqual = 0x6,
+    Above = 0x7,
+    Parity = 0xa,
+};
+
+// Emits the few x86-64 instructions the LoopCompiler needs. Memory operands are always
+// relative to rdi, which holds the variable array for the whole function.
+class Assembler
+{
+public:
+    struct Label
+    {
+        std::size_t position{0};
+        bool bound{false};
+        // Offsets of rel32 fields to patch once the label is bound
+        std::vector<std::size_t> uses;
+    };
+
+    static constexpr std::uint8_t Prefix_Double = 0xf2;
+    static constexpr std::uint8_t Prefix_Packed = 0x66;
+
+    static constexpr std::uint8_t Op_Load = 0x10;
+    static constexpr std::uint8_t Op_Store = 0x11;
+    static constexpr std::uint8_t Op_Compare = 0x2e;
+    static constexpr std::uint8_t Op_Xor = 0x57;
+    static constexpr std::uint8_t Op_Add = 0x58;
+    static constexpr std::uint8_t Op_Multiply = 0x59;
+    static constexpr std::uint8_t Op_Subtract = 0x5c;
+    static constexpr std::uint8_t Op_Divide = 0x5e;
+
+    // op xmm(reg), xmm(rm)
+    void sse(std::uint8_t prefix, std::uint8_t opcode, int reg, int rm)
+    {
+        m_code.push_back(prefix);
+        rex(false, reg, rm);
+        m_code.push_back(0x0f);
+        m_code.push_back(opcode);
+        m_code.push_back(modrm(0b11, reg, rm));
+    }
+
+    // op xmm(reg), [rdi + index * 8]
+    void sseMemory(std::uint8_t prefix, std::uint8_t opcode, int reg, int index)
+    {
+        constexpr int Rdi = 7;
+        auto displacement = static_cast<std::int32_t>(index * sizeof(double));
+        m_code.push_back(prefix);
+        rex(false, reg, 0);
+        m_code.push_back(0x0f);
+        m_code.push_back(opcode);
+        if (displacement < 128)
+        {
+            m_code.push_back(modrm(0b01, reg, Rdi));
+            m_code.push_back(static_cast<std::uint8_t>(displacement));
+        }
+        else
+        {
+            m_code.push_back(modrm(0b10, reg, Rdi));
+            imm32(displacement);
+        }
+    }
+
+    // Goes through rax as there is no immediate form for xmm registers
+    void loadConstant(int reg, double value)
+    {
+        std::uint64_t bits{};
+        std::memcpy(&bits, &value, sizeof(bits));
+        // mov rax, imm64
+        m_code.push_back(0x48);
+        m_code.push_back(0xb8);
+        for (int i = 0; i < 8; i++)
+        {
+            m_code.push_back(static_cast<std::uint8_t>(bits >> (i * 8)));
+        }
+        // movq xmm(reg), rax
+        m_code.push_back(Prefix_Packed);
+        rex(true, reg, 0);
+        m_code.push_back(0x0f);
+        m_code.push_back(0x6e);
+        m_code.push_back(modrm(0b11, reg, 0));
+    }
+
+    void jump(Label& label)
+    {
+        m_code.push_back(0xe9);
+        use(label);
+    }
+
+    void jumpIf(Condition condition, Label& label)
+    {
+        m_code.push_back(0x0f);
+        m_code.push_back(0x80 | static_cast<std::uint8_t>(condition));
+        use(label);
+    }
+
+    void bind(Label& label)
+    {
+        label.position = m_code.size();
+        label.bound = true;
+        for (auto use : label.uses)
+        {
+            patch(use, label.position);
+        }
+        label.uses.clear();
+    }
+
+    void ret() { m_code.push_back(0xc3); }
+
+    [[nodiscard]] const std::vector<std::uint8_t>& code() const { return m_code; }
+
+private:
+    static std::uint8_t modrm(int mod, int reg, int rm)
+    {
+        return static_cast<std::uint8_t>((mod << 6) | ((reg & 7) << 3) | (rm & 7));
+    }
+
+    // Only emitted when needed, xmm8-15 take the extension bits
+    void rex(bool wide, int reg, int rm)
+    {
+        std::uint8_t prefix =
+            0x40 | (wide ? 0x08 : 0) | (reg >= 8 ? 0x04 : 0) | (rm >= 8 ? 0x01 : 0);
+        if (prefix != 0x40)
+        {
+            m_code.push_back(prefix);
+        }
+    }
+
+    void imm32(std::int32_t value)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            auto bits = static_cast<std::uint32_t>(value);
+            m_code.push_back(static_cast<std::uint8_t>(bits >> (i * 8)));
+        }
+    }
+
+    void use(Label& label)
+    {
+        auto field = m_code.size();
+        imm32(0);
+        if (label.bound)
+        {
+            patch(field, label.position);
+        }
+        else
+        {
+            label.uses.push_back(field);
+        }
+    }
+
+    // rel32 is counted from the end of the field
+    void patch(std::size_t field, std::size_t target)
+    {
+        auto relative = static_cast<std::int32_t>(static_cast<std::int64_t>(target) -
+                                                  static_cast<std::int64_t>(field + 4));
+        std::memcpy(&m_code[field], &relative, sizeof(relative));
+    }
+
+    std::vector<std::uint8_t> m_code;
+};
+
+// Generates `void loop(double* variables)` for one while statement. Every expression in the
+// loop must be a number: literals, variables, assignments and arithmetic. Comparisons and
+// logical operators are only accepted as conditions, where they become branches. Anything
+// else (print, strings, declarations, undefined variables) throws JitError.
+class LoopCompiler : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    void compile(StatementWhile& loop)
+    {
+        loop.accept(*this);
+        m_assembler.ret();
+    }
+
+    [[nodiscard]] const std::vector<std::uint8_t>& code() const { return m_assembler.code(); }
+    [[nodiscard]] std::vector<NativeLoop::Variable> takeVariables()
+    {
+        return std::move(m_variables);
+    }
+
+private:
+    static constexpr int Register_Count = 16;
+
+    void visitStatementBlock(StatementBlock& statement) override
+    {
+        if (statement.getScoped())
+        {
+            throw JitError("block declares variables");
+        }
+        if (statement.getStatements() == nullptr)
+        {
+            return;
+        }
+        for (auto& inner : *statement.getStatements())
+        {
+            execute(rawNode(inner));
+        }
+    }
+
+    void visitStatementExpression(StatementExpression& statement) override
+    {
+        evaluate(statement.getExpression(), 0);
+    }
+
+    void visitStatementIf(StatementIf& statement) override
+    {
+        Assembler::Label otherwise;
+        branch(statement.getCondition(), false, otherwise);
+        execute(statement.getthenBranch());
+        if (statement.getelseBranch() == nullptr)
+        {
+            m_assembler.bind(otherwise);
+            return;
+        }
+        Assembler::Label end;
+        m_assembler.jump(end);
+        m_assembler.bind(otherwise);
+        execute(statement.getelseBranch());
+        m_assembler.bind(end);
+    }
+
+    void visitStatementPrint(StatementPrint& /*statement*/) override
+    {
+        throw JitError("print in loop");
+    }
+
+    void visitStatementVariable(StatementVariable& /*statement*/) override
+    {
+        throw JitError("declaration in loop");
+    }
+
+    void visitStatementWhile(StatementWhile& statement) override
+    {
+        Assembler::Label top;
+        Assembler::Label end;
+        m_assembler.bind(top);
+        branch(statement.getCondition(), false, end);
+        execute(statement.getBody());
+        m_assembler.jump(top);
+        m_assembler.bind(end);
+    }
+
+    void visitExpressionAssign(ExpressionAssign& expression) override
+    {
+        auto target = m_register;
+        evaluate(expression.getValue(), target);
+        auto index = variable(expression.getDepth(), expression.getSlot(), true);
+        m_assembler.sseMemory(Assembler::Prefix_Double, Assembler::Op_Store, target, index);
+    }
+
+    void visitExpressionBinary(ExpressionBinary& expression) override
+    {
+        std::uint8_t opcode{};
+        switch (expression.getToken().type())
+        {
+        case TokenType::PLUS:
+            opcode = Assembler::Op_Add;
+            break;
+        case TokenType::MINUS:
+            opcode = Assembler::Op_Subtract;
+            break;
+        case TokenType::STAR:
+            opcode = Assembler::Op_Multiply;
+            break;
+        case TokenType::SLASH:
+            opcode = Assembler::Op_Divide;
+            break;
+        default:
+            throw JitError("operator " + std::string(expression.getToken().lexeme()) +
+                           " used as a value");
+        }
+
+        auto target = m_register;
+        evaluate(expression.getLeft(), target);
+        // A variable on the right is used straight from memory
+        auto* right = dynamic_cast<ExpressionVariable*>(expression.getRight());
+        if (right != nullptr)
+        {
+            auto index = variable(right->getDepth(), right->getSlot(), false);
+            m_assembler.sseMemory(Assembler::Prefix_Double, opcode, target, index);
+            return;
+        }
+        evaluate(expression.getRight(), scratch(target));
+        m_assembler.sse(Assembler::Prefix_Double, opcode, target, target + 1);
+    }
+
+    void visitExpressionLogical(ExpressionLogical& /*expression*/) override
+    {
+        throw JitError("logical operator used as a value");
+    }
+
+    void visitExpressionGrouping(ExpressionGrouping& expression) override
+    {
+        evaluate(expression.getExpression(), m_register);
+    }
+
+    void visitExpressionLiteral(ExpressionLiteral& expression) override
+    {
+        if (!expression.getValue().isNumber())
+        {
+            throw JitError("literal " + expression.getValue().repr() + " is not a number");
+        }
+        m_assembler.loadConstant(m_register, expression.getValue().asNumber());
+    }
+
+    void visitExpressionUnary(ExpressionUnary& expression) override
+    {
+        if (expression.getToken().type() != TokenType::MINUS)
+        {
+            throw JitError("operator " + std::string(expression.getToken().lexeme()) +
+                           " used as a value");
+        }
+        auto target = m_register;
+        evaluate(expression.getExpression(), target);
+        // Flipping the sign bit keeps -0 distinct from 0 like the interpreter
+        m_assembler.loadConstant(scratch(target), -0.0);
+        m_assembler.sse(Assembler::Prefix_Packed, Assembler::Op_Xor, target, target + 1);
+    }
+
+    void visitExpressionVariable(ExpressionVariable& expression) override
+    {
+        auto index = variable(expression.getDepth(), expression.getSlot(), false);
+        m_assembler.sseMemory(Assembler::Prefix_Double, Assembler::Op_Load, m_register, index);
+    }
+
+    void execute(Statement* statement)
+    {
+        if (statement == nullptr)
+        {
+            throw JitError("null statement");
+        }
+        statement->accept(*this);
+    }
+
+    // Leaves the value of expression in xmm(target), registers above it are free to clobber
+    void evaluate(Expression* expression, int target)
+    {
+        if (expression == nullptr)
+        {
+            throw JitError("null expression");
+        }
+        auto previous = std::exchange(m_register, target);
+        expression->accept(*this);
+        m_register = previous;
+    }
+
+    static int scratch(int target)
+    {
+        if (target + 1 >= Register_Count)
+        {
+            throw JitError("expression nested too deeply");
+        }
+        return target + 1;
+    }
+
+    // Jumps to label when the truthiness of condition is sense
+    void branch(Expression* condition, bool sense, Assembler::Label& label)
+    {
+        if (auto* grouping = dynamic_cast<ExpressionGrouping*>(condition))
+        {
+            branch(grouping->getExpression(), sense, label);
+        }
+        else if (auto* literal = dynamic_cast<ExpressionLiteral*>(condition))
+        {
+            if (literal->getValue().isTruthy() == sense)
+            {
+                m_assembler.jump(label);
+            }
+        }
+        else if (auto* unary = dynamic_cast<ExpressionUnary*>(condition);
+                 unary != nullptr && unary->getToken().type() == TokenType::BANG)
+        {
+            branch(unary->getExpression(), !sense, label);
+        }
+        else if (auto* logical = dynamic_cast<ExpressionLogical*>(condition))
+        {
+            // "or" is decided by a truthy left side, "and" by a falsey one
+            bool decides = logical->getToken().type() == TokenType::OR;
+            if (decides == sense)
+            {
+                branch(logical->getLeft(), sense, label);
+                branch(logical->getRight(), sense, label);
+                return;
+            }
+            Assembler::Label skip;
+            branch(logical->getLeft(), decides, skip);
+            branch(logical->getRight(), sense, label);
+            m_assembler.bind(skip);
+        }
+        else if (auto* binary = dynamic_cast<ExpressionBinary*>(condition))
+        {
+            compare(*binary, sense, label);
+        }
+        else
+        {
+            throw JitError("condition is not a comparison");
+        }
+    }
+
+    void compare(ExpressionBinary& expression, bool sense, Assembler::Label& label)
+    {
+        auto type = expression.getToken().type();
+        // ucomisd sets the flags like an unsigned compare, an unordered result (NaN) sets
+        // ZF, PF and CF which makes every ordered comparison false
+        bool swapped = type == TokenType::LESS || type == TokenType::LESS_EQUAL;
+        Condition when_true{};
+        Condition when_false{};
+        switch (type)
+        {
+        case TokenType::LESS:
+        case TokenType::GREATER:
+            when_true = Condition::Above;
+            when_false = Condition::BelowEqual;
+            break;
+        case TokenType::LESS_EQUAL:
+        case TokenType::GREATER_EQUAL:
+            when_true = Condition::AboveEqual;
+            when_false = Condition::Below;
+            break;
+        case TokenType::EQUAL_EQUAL:
+        case TokenType::BANG_EQUAL:
+            break;
+        default:
+            throw JitError("condition is not a comparison");
+        }
+
+        evaluate(expression.getLeft(), 0);
+        evaluate(expression.getRight(), 1);
+        m_assembler.sse(Assembler::Prefix_Packed, Assembler::Op_Compare, swapped ? 1 : 0,
+                        swapped ? 0 : 1);
+
+        if (type != TokenType::EQUAL_EQUAL && type != TokenType::BANG_EQUAL)
+        {
+            m_assembler.jumpIf(sense ? when_true : when_false, label);
+            return;
+        }
+        // Equal needs ZF set and PF clear
+        if ((type == TokenType::EQUAL_EQUAL) == sense)
+        {
+            Assembler::Label unordered;
+            m_assembler.jumpIf(Condition::Parity, unordered);
+            m_assembler.jumpIf(Condition::Equal, label);
+            m_assembler.bind(unordered);
+        }
+        else
+        {
+            m_assembler.jumpIf(Condition::Parity, label);
+            m_assembler.jumpIf(Condition::NotEqual, label);
+        }
+    }
+
+    // Index of a variable in the array passed to the code
+    int variable(int depth, int slot, bool assigned)
+    {
+        if (depth < 0)
+        {
+            throw JitError("undefined variable");
+        }
+        auto [found, inserted] =
+            m_indices.try_emplace({depth, slot}, static_cast<int>(m_variables.size()));
+        if (inserted)
+        {
+            m_variables.push_back({depth, slot, assigned});
+        }
+        m_variables[found->second].assigned |= assigned;
+        return found->second;
+    }
+
+    Assembler m_assembler;
+    // Register the expression being visited leaves its value in
+    int m_register{0};
+    std::map<std::pair<int, int>, int> m_indices;
+    std::vector<NativeLoop::Variable> m_variables;
+};
+}  // namespace
+
+ExecutableBuffer::ExecutableBuffer(const std::vector<std::uint8_t>& code)
+{
+    auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    auto size = (code.size() + page - 1) / page * page;
+    void* memory =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        throw JitError("Could not map code: " + std::string(std::strerror(errno)));
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0)
+    {
+        auto error = errno;
+        munmap(memory, size);
+        throw JitError("Could not make code executable: " + std::string(std::strerror(error)));
+    }
+    m_memory = memory;
+    m_size = size;
+}
+
+ExecutableBuffer::~ExecutableBuffer()
+{
+    if (m_memory != nullptr)
+    {
+        munmap(m_memory, m_size);
+    }
+}
+#else
+ExecutableBuffer::ExecutableBuffer(const std::vector<std::uint8_t>& /*code*/)
+{
+    throw JitError("No native code support on this target");
+}
+
+ExecutableBuffer::~ExecutableBuffer() = default;
+#endif
+
+NativeLoop::NativeLoop(const std::vector<std::uint8_t>& code, std::vector<Variable> variables)
+    : m_code(code), m_variables(std::move(variables)), m_values(m_variables.size())
+{
+}
+
+bool NativeLoop::run(Environment& environment)
+{
+    for (std::size_t i = 0; i < m_variables.size(); i++)
+    {
+        const auto& value = environment.get(m_variables[i].depth, m_variables[i].slot);
+        if (!value.isNumber())
+        {
+            LOX_DEBUG("Native loop guard failed on depth {} slot {}", m_variables[i].depth,
+                      m_variables[i].slot);
+            m_guard_failures++;
+            return false;
+        }
+        m_values[i] = value.asNumber();
+    }
+
+    using Function = void (*)(double*);
+    reinterpret_cast<Function>(const_cast<void*>(m_code.entry()))(m_values.data());
+
+    for (std::size_t i = 0; i < m_variables.size(); i++)
+    {
+        if (m_variables[i].assigned)
+        {
+            environment.assign(m_variables[i].depth, m_variables[i].slot, Value(m_values[i]));
+        }
+    }
+    return true;
+}
+
+NativeLoop* Jit::compile(StatementWhile& loop, Arena& arena)
+{
+#if LOX_JIT_X86
+    try
+    {
+        LoopCompiler compiler;
+        compiler.compile(loop);
+        auto* native = arena.create<NativeLoop>(compiler.code(), compiler.takeVariables());
+        spdlog::debug("Compiled loop to {} bytes of machine code", compiler.code().size());
+        return native;
+    }
+    catch (JitError& error)
+    {
+        spdlog::debug("Not compiling loop: {}", error.what());
+    }
+#else
+    (void)loop;
+    (void)arena;
+#endif
+    return nullptr;
+}
+}  // namespace lox
@@ -0,0 +1,84 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "arena.hpp"
+#include "environment.hpp"
+
+// The generated code is x86-64 SSE2, anything else always runs in the interpreter
+#if defined(LOX_JIT_ENABLED) && defined(__x86_64__) && __has_include(<sys/mman.h>)
+#define LOX_JIT_X86 1
+#else
+#define LOX_JIT_X86 0
+#endif
+
+namespace lox
+{
+class StatementWhile;
+
+// Page aligned memory holding generated code. It is only writable while the code is copied
+// in and only executable afterwards.
+class ExecutableBuffer
+{
+public:
+    explicit ExecutableBuffer(const std::vector<std::uint8_t>& code);
+    ExecutableBuffer(const ExecutableBuffer&) = delete;
+    ExecutableBuffer& operator=(const ExecutableBuffer&) = delete;
+    ~ExecutableBuffer();
+
+    [[nodiscard]] const void* entry() const { return m_memory; }
+    [[nodiscard]] std::size_t size() const { return m_size; }
+
+private:
+    void* m_memory{nullptr};
+    std::size_t m_size{0};
+};
+
+// A while loop compiled to machine code. The code works on an array of doubles holding the
+// variables the loop uses, run() copies them out of the environment and back.
+class NativeLoop
+{
+public:
+    // A variable used by the loop, addressed like ExpressionVariable from the loop's scope
+    struct Variable
+    {
+        int depth;
+        int slot;
+        bool assigned;
+    };
+
+    NativeLoop(const std::vector<std::uint8_t>& code, std::vector<Variable> variables);
+
+    // Runs the loop to completion, starting with its condition. Only numbers are ever stored
+    // by the code, so checking the variables on entry is enough: when one is not a number
+    // nothing runs and false is returned for the interpreter to carry on.
+    bool run(Environment& environment);
+    // Runs that returned false so far
+    [[nodiscard]] int guardFailures() const { return m_guard_failures; }
+
+private:
+    ExecutableBuffer m_code;
+    std::vector<Variable> m_variables;
+    std::vector<double> m_values;
+    int m_guard_failures{0};
+};
+
+// Baseline compiler for while loops that only do arithmetic on number variables.
+// Expressions are evaluated in SSE registers, variables stay in memory.
+class Jit
+{
+public:
+    static constexpr bool Enabled = LOX_JIT_X86;
+    // Iterations a loop runs in the interpreter before it is compiled
+    static constexpr int Hot_Loop_Iterations = 1000;
+    // Failed guards after which a loop is dropped and stays interpreted. A variable rarely goes
+    // back to being a number, and each failure rechecks every guard for a single iteration.
+    static constexpr int Max_Guard_Failures = 16;
+
+    // Returns nullptr when the loop does something the compiler does not handle. The NativeLoop
+    // is created in arena, the one of the Program holding loop, so its code is unmapped when
+    // the program is dropped or cleared.
+    static NativeLoop* compile(StatementWhile& loop, Arena& arena);
+};
+}  // namespace lox
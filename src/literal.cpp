@@ -1,5 +1,7 @@
 #include "literal.hpp"
 
+#include "number_format.hpp"
+
 namespace lox
 {
 const std::string &literalValTypeToStr(LiteralValType type)
@@ -48,7 +50,7 @@ const std::string &literalValTypeToStr(LiteralValType type)
     }
     if (const auto *pdoub(std::get_if<double>(&m_value)); pdoub)
     {
-        return std::to_string(*pdoub);
+        return formatNumber(*pdoub);
     }
     if (const auto *pbool(std::get_if<bool>(&m_value)); pbool)
     {
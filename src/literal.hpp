@@ -43,10 +43,12 @@ public:
     LiteralVal() : m_value(NilLiteral()) {}
     LiteralVal(const LiteralVal &other) = default;
     LiteralVal(LiteralVal &&other) = default;
+    LiteralVal &operator=(const LiteralVal &other) = default;
+    LiteralVal &operator=(LiteralVal &&other) = default;
 
     bool operator==(const LiteralVal &other) const { return m_value == other.m_value; }
 
-    bool operator!=(const LiteralVal &other) const { return m_value == other.m_value; }
+    bool operator!=(const LiteralVal &other) const { return !(m_value == other.m_value); }
 
     [[nodiscard]] LiteralValType type() const;
 
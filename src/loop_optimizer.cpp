@@ -0,0 +1,400 @@
+#include "loop_optimizer.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <map>
+#include <utility>
+
+#include "trace.hpp"
+
+namespace lox
+{
+namespace
+{
+// Variables by (scope level, slot), with the number of assignments to each
+using Assignments = std::map<std::pair<int, int>, int>;
+
+// Counts the assignments in a loop
+class AssignmentCollector : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    explicit AssignmentCollector(int level) : m_level(level) {}
+
+    [[nodiscard]] Assignments collect(StatementWhile& loop)
+    {
+        loop.accept(*this);
+        return std::move(m_assignments);
+    }
+
+private:
+    void visit(Expression* expression)
+    {
+        if (expression != nullptr)
+        {
+            expression->accept(*this);
+        }
+    }
+    void visit(Statement* statement)
+    {
+        if (statement != nullptr)
+        {
+            statement->accept(*this);
+        }
+    }
+
+    void visitStatementBlock(StatementBlock& statement) override
+    {
+        if (statement.getStatements() == nullptr)
+        {
+            return;
+        }
+        m_level += statement.getScoped() ? 1 : 0;
+        for (auto& inner : *statement.getStatements())
+        {
+            visit(rawNode(inner));
+        }
+        m_level -= statement.getScoped() ? 1 : 0;
+    }
+    void visitStatementExpression(StatementExpression& statement) override
+    {
+        visit(statement.getExpression());
+    }
+    void visitStatementIf(StatementIf& statement) override
+    {
+        visit(statement.getCondition());
+        visit(statement.getthenBranch());
+        visit(statement.getelseBranch());
+    }
+    void visitStatementPrint(StatementPrint& statement) override
+    {
+        visit(statement.getExpression());
+    }
+    void visitStatementWhile(StatementWhile& statement) override
+    {
+        visit(statement.getCondition());
+        visit(statement.getBody());
+    }
+    void visitStatementVariable(StatementVariable& statement) override
+    {
+        visit(statement.getInitializer());
+    }
+
+    void visitExpressionAssign(ExpressionAssign& expression) override
+    {
+        visit(expression.getValue());
+        if (expression.getDepth() >= 0)
+        {
+            m_assignments[{m_level - expression.getDepth(), expression.getSlot()}]++;
+        }
+    }
+    void visitExpressionBinary(ExpressionBinary& expression) override
+    {
+        visit(expression.getLeft());
+        visit(expression.getRight());
+    }
+    void visitExpressionLogical(ExpressionLogical& expression) override
+    {
+        visit(expression.getLeft());
+        visit(expression.getRight());
+    }
+    void visitExpressionGrouping(ExpressionGrouping& expression) override
+    {
+        visit(expression.getExpression());
+    }
+    void visitExpressionLiteral(ExpressionLiteral& /*expression*/) override {}
+    void visitExpressionUnary(ExpressionUnary& expression) override
+    {
+        visit(expression.getExpression());
+    }
+    void visitExpressionVariable(ExpressionVariable& /*expression*/) override {}
+
+    int m_level;
+    Assignments m_assignments;
+};
+
+// True if evaluating expression in the scope of the loop has no side effect and gives the same
+// result on every iteration
+bool invariant(Expression* expression, const Assignments& assignments, int level)
+{
+    if (expression == nullptr)
+    {
+        return false;
+    }
+    if (dynamic_cast<ExpressionLiteral*>(expression) != nullptr)
+    {
+        return true;
+    }
+    if (auto* variable = dynamic_cast<ExpressionVariable*>(expression))
+    {
+        return variable->getDepth() >= 0 &&
+               assignments.count({level - variable->getDepth(), variable->getSlot()}) == 0;
+    }
+    if (auto* grouping = dynamic_cast<ExpressionGrouping*>(expression))
+    {
+        return invariant(grouping->getExpression(), assignments, level);
+    }
+    if (auto* unary = dynamic_cast<ExpressionUnary*>(expression))
+    {
+        return invariant(unary->getExpression(), assignments, level);
+    }
+    if (auto* binary = dynamic_cast<ExpressionBinary*>(expression))
+    {
+        return invariant(binary->getLeft(), assignments, level) &&
+               invariant(binary->getRight(), assignments, level);
+    }
+    if (auto* logical = dynamic_cast<ExpressionLogical*>(expression))
+    {
+        return invariant(logical->getLeft(), assignments, level) &&
+               invariant(logical->getRight(), assignments, level);
+    }
+    return false;
+}
+
+bool arithmetic(TokenType type)
+{
+    return type == TokenType::PLUS || type == TokenType::MINUS || type == TokenType::STAR ||
+           type == TokenType::SLASH;
+}
+
+// Marks the largest invariant expressions in the scope of a loop, nested loops included.
+// Scoped blocks are skipped, their variables live in an environment the loop entry has not
+// created yet.
+class InvariantHoister : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    InvariantHoister(const Assignments& assignments, int level, LoopPlan& plan)
+        : m_assignments(assignments), m_level(level), m_plan(plan)
+    {
+    }
+
+    void hoist(StatementWhile& loop) { visitStatementWhile(loop); }
+
+private:
+    void visit(Expression* expression)
+    {
+        if (expression != nullptr)
+        {
+            expression->accept(*this);
+        }
+    }
+    void visit(Statement* statement)
+    {
+        if (statement != nullptr)
+        {
+            statement->accept(*this);
+        }
+    }
+
+    void visitStatementBlock(StatementBlock& statement) override
+    {
+        if (statement.getScoped() || statement.getStatements() == nullptr)
+        {
+            return;
+        }
+        for (auto& inner : *statement.getStatements())
+        {
+            visit(rawNode(inner));
+        }
+    }
+    void visitStatementExpression(StatementExpression& statement) override
+    {
+        visit(statement.getExpression());
+    }
+    void visitStatementIf(StatementIf& statement) override
+    {
+        visit(statement.getCondition());
+        visit(statement.getthenBranch());
+        visit(statement.getelseBranch());
+    }
+    void visitStatementPrint(StatementPrint& statement) override
+    {
+        visit(statement.getExpression());
+    }
+    void visitStatementWhile(StatementWhile& statement) override
+    {
+        visit(statement.getCondition());
+        visit(statement.getBody());
+    }
+    void visitStatementVariable(StatementVariable& statement) override
+    {
+        visit(statement.getInitializer());
+    }
+
+    void visitExpressionAssign(ExpressionAssign& expression) override
+    {
+        visit(expression.getValue());
+    }
+    void visitExpressionBinary(ExpressionBinary& expression) override
+    {
+        if (expression.getHoisted())
+        {
+            return;
+        }
+        // Unboxed arithmetic cannot fail, so computing it early or when the branch it is in
+        // would not run changes nothing
+        if (expression.getUnboxed() && arithmetic(expression.getToken().type()) &&
+            invariant(&expression, m_assignments, m_level))
+        {
+            expression.setHoisted(true);
+            m_plan.invariants.push_back(&expression);
+            return;
+        }
+        visit(expression.getLeft());
+        visit(expression.getRight());
+    }
+    void visitExpressionLogical(ExpressionLogical& expression) override
+    {
+        visit(expression.getLeft());
+        visit(expression.getRight());
+    }
+    void visitExpressionGrouping(ExpressionGrouping& expression) override
+    {
+        visit(expression.getExpression());
+    }
+    void visitExpressionLiteral(ExpressionLiteral& /*expression*/) override {}
+    void visitExpressionUnary(ExpressionUnary& expression) override
+    {
+        visit(expression.getExpression());
+    }
+    void visitExpressionVariable(ExpressionVariable& /*expression*/) override {}
+
+    const Assignments& m_assignments;
+    int m_level;
+    LoopPlan& m_plan;
+};
+
+bool comparison(TokenType type)
+{
+    return type == TokenType::LESS || type == TokenType::LESS_EQUAL ||
+           type == TokenType::GREATER || type == TokenType::GREATER_EQUAL;
+}
+
+bool sameVariable(ExpressionVariable* variable, int depth, int slot)
+{
+    return variable != nullptr && variable->getDepth() == depth && variable->getSlot() == slot;
+}
+
+// Fills the counted loop part of plan if loop has that shape
+void recognizeCounted(StatementWhile& loop, const Assignments& assignments, int level,
+                      LoopPlan& plan)
+{
+    auto* condition = dynamic_cast<ExpressionBinary*>(loop.getCondition());
+    if (condition == nullptr || !comparison(condition->getToken().type()))
+    {
+        return;
+    }
+    auto* index = dynamic_cast<ExpressionVariable*>(condition->getLeft());
+    if (index == nullptr || index->getDepth() < 0 ||
+        !invariant(condition->getRight(), assignments, level))
+    {
+        return;
+    }
+    auto found = assignments.find({level - index->getDepth(), index->getSlot()});
+    if (found == assignments.end() || found->second != 1)
+    {
+        return;
+    }
+
+    // The one assignment has to be the last statement of the body
+    auto* body = dynamic_cast<StatementBlock*>(loop.getBody());
+    if (body == nullptr || body->getScoped() || body->getStatements() == nullptr ||
+        body->getStatements()->empty())
+    {
+        return;
+    }
+    auto* last = dynamic_cast<StatementExpression*>(rawNode(body->getStatements()->back()));
+    auto* increment =
+        last != nullptr ? dynamic_cast<ExpressionAssign*>(last->getExpression()) : nullptr;
+    if (increment == nullptr || increment->getDepth() != index->getDepth() ||
+        increment->getSlot() != index->getSlot())
+    {
+        return;
+    }
+    auto* value = dynamic_cast<ExpressionBinary*>(increment->getValue());
+    if (value == nullptr || (value->getToken().type() != TokenType::PLUS &&
+                             value->getToken().type() != TokenType::MINUS))
+    {
+        return;
+    }
+    auto* step = dynamic_cast<ExpressionLiteral*>(value->getRight());
+    if (!sameVariable(dynamic_cast<ExpressionVariable*>(value->getLeft()), index->getDepth(),
+                      index->getSlot()) ||
+        step == nullptr || !step->getValue().isNumber())
+    {
+        return;
+    }
+
+    plan.counted = true;
+    plan.depth = index->getDepth();
+    plan.slot = index->getSlot();
+    plan.comparison = condition->getToken().type();
+    plan.limit = condition->getRight();
+    plan.step = value->getToken().type() == TokenType::PLUS ? step->getValue().asNumber()
+                                                            : -step->getValue().asNumber();
+}
+}  // namespace
+
+void LoopOptimizer::optimize(Program& program)
+{
+    m_level = 0;
+    for (auto& statement : program.statements())
+    {
+        optimize(rawNode(statement));
+    }
+}
+
+void LoopOptimizer::optimize(Statement* statement)
+{
+    if (statement != nullptr)
+    {
+        statement->accept(*this);
+    }
+}
+
+void LoopOptimizer::plan(StatementWhile& loop)
+{
+    auto assignments = AssignmentCollector(m_level).collect(loop);
+    LoopPlan plan;
+    recognizeCounted(loop, assignments, m_level, plan);
+    InvariantHoister(assignments, m_level, plan).hoist(loop);
+    if (plan.counted || !plan.invariants.empty())
+    {
+        LOX_DEBUG("Loop plan: counted {}, {} invariants", plan.counted,
+                  plan.invariants.size());
+    }
+    loop.setPlan(std::move(plan));
+}
+
+void LoopOptimizer::visitStatementBlock(StatementBlock& statement)
+{
+    if (statement.getStatements() == nullptr)
+    {
+        return;
+    }
+    m_level += statement.getScoped() ? 1 : 0;
+    for (auto& inner : *statement.getStatements())
+    {
+        optimize(rawNode(inner));
+    }
+    m_level -= statement.getScoped() ? 1 : 0;
+}
+
+void LoopOptimizer::visitStatementExpression(StatementExpression& /*statement*/) {}
+
+void LoopOptimizer::visitStatementIf(StatementIf& statement)
+{
+    optimize(statement.getthenBranch());
+    optimize(statement.getelseBranch());
+}
+
+void LoopOptimizer::visitStatementPrint(StatementPrint& /*statement*/) {}
+
+void LoopOptimizer::visitStatementWhile(StatementWhile& statement)
+{
+    // Outer loops first so invariants go to the outermost loop they are invariant in
+    plan(statement);
+    optimize(statement.getBody());
+}
+
+void LoopOptimizer::visitStatementVariable(StatementVariable& /*statement*/) {}
+}  // namespace lox
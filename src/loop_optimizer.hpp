@@ -0,0 +1,36 @@
+#pragma once
+#include "expression_ast.hpp"
+#include "program.hpp"
+#include "statement_ast.hpp"
+
+namespace lox
+{
+// Static pass run after TypeInference that fills the LoopPlan of every while loop.
+//  - Invariant hoisting: unboxed arithmetic that only reads variables the loop never assigns is
+//    marked Hoisted and listed in the plan of the outermost loop it is invariant in. Only
+//    expressions in the scope of the loop itself qualify, as that is the environment the
+//    Interpreter computes them in.
+//  - Counted loops: the shape `for` desugars to, an unscoped body ending in `i = i + step`
+//    with a number literal step, a condition comparing i to an invariant limit and no other
+//    assignment to i.
+class LoopOptimizer : public StatementVisitorVoid
+{
+public:
+    void optimize(Program& program);
+
+private:
+    void optimize(Statement* statement);
+    void plan(StatementWhile& loop);
+
+    void visitStatementBlock(StatementBlock& statement) override;
+    void visitStatementExpression(StatementExpression& statement) override;
+    void visitStatementIf(StatementIf& statement) override;
+    void visitStatementPrint(StatementPrint& statement) override;
+    void visitStatementWhile(StatementWhile& statement) override;
+    void visitStatementVariable(StatementVariable& statement) override;
+
+    // Number of scoped blocks around the statement being visited, so that variables can be
+    // compared across scopes by (level - depth, slot)
+    int m_level{0};
+};
+}  // namespace lox
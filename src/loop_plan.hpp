@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+
+#include "token.hpp"
+
+namespace lox
+{
+class Expression;
+class ExpressionBinary;
+
+// What the LoopOptimizer found out about a while loop, used by the Interpreter
+struct LoopPlan
+{
+    // Loop invariant arithmetic, computed once each time the loop is entered
+    std::vector<ExpressionBinary*> invariants;
+
+    // Set for counted loops `while (i < limit) { ...; i = i + step; }` where nothing else in the
+    // loop assigns i and limit is invariant. The Interpreter then keeps i in a double and runs
+    // the condition and the increment without evaluating them.
+    bool counted{false};
+    int depth{0};
+    int slot{0};
+    TokenType comparison{TokenType::LESS};
+    Expression* limit{nullptr};
+    double step{0};
+};
+}  // namespace lox
@@ -0,0 +1,27 @@
+#include "number_format.hpp"
+
+#include <array>
+#include <charconv>
+#include <cmath>
+
+namespace lox
+{
+namespace
+{
+// Magnitudes printed with all their digits, the others in exponent form
+constexpr double Min_Fixed = 1e-6;
+constexpr double Max_Fixed = 1e21;
+}  // namespace
+
+std::string formatNumber(double number)
+{
+    // Enough for the longest fixed form, "-0.0000012345678901234567", and any exponent form
+    std::array<char, 32> buffer{};
+    auto magnitude = std::fabs(number);
+    auto format = magnitude == 0 || (magnitude >= Min_Fixed && magnitude < Max_Fixed)
+                      ? std::chars_format::fixed
+                      : std::chars_format::scientific;
+    auto result = std::to_chars(buffer.data(), buffer.data() + buffer.size(), number, format);
+    return {buffer.data(), result.ptr};
+}
+}  // namespace lox
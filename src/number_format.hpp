@@ -0,0 +1,10 @@
+#pragma once
+#include <string>
+
+namespace lox
+{
+// Shortest digits that read back as the same double: 3 prints as "3", 100000 as "100000" and
+// 0.1 as "0.1". Magnitudes below 1e-6 or from 1e21 up are in exponent form, "1e+21". Does not
+// depend on the locale.
+std::string formatNumber(double number);
+}  // namespace lox
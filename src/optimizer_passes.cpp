@@ -0,0 +1,102 @@
+#include "optimizer_passes.hpp"
+
+#include <spdlog/spdlog.h>
+
+namespace lox
+{
+namespace
+{
+ExpressionLiteral* asLiteral(Expression* expression)
+{
+    return dynamic_cast<ExpressionLiteral*>(expression);
+}
+}  // namespace
+
+void ConstantFolding::visitExpressionBinary(ExpressionBinary& expression)
+{
+    AstRewriter::visitExpressionBinary(expression);
+    if (asLiteral(expression.getLeft()) != nullptr && asLiteral(expression.getRight()) != nullptr)
+    {
+        fold(expression);
+    }
+}
+
+void ConstantFolding::visitExpressionGrouping(ExpressionGrouping& expression)
+{
+    AstRewriter::visitExpressionGrouping(expression);
+    replace(expression.takeExpression());
+}
+
+void ConstantFolding::visitExpressionLogical(ExpressionLogical& expression)
+{
+    AstRewriter::visitExpressionLogical(expression);
+    auto* left = asLiteral(expression.getLeft());
+    if (left == nullptr)
+    {
+        return;
+    }
+    // "or" short circuits on a truthy left side, "and" on a falsey one
+    bool short_circuits =
+        (expression.getToken().type() == TokenType::OR) == left->getValue().isTruthy();
+    replace(short_circuits ? expression.takeLeft() : expression.takeRight());
+}
+
+void ConstantFolding::visitExpressionUnary(ExpressionUnary& expression)
+{
+    AstRewriter::visitExpressionUnary(expression);
+    if (asLiteral(expression.getExpression()) != nullptr)
+    {
+        fold(expression);
+    }
+}
+
+void ConstantFolding::fold(Expression& expression)
+{
+    try
+    {
+        replace(program().make<ExpressionLiteral>(m_evaluator.evaluate(&expression)));
+    }
+    catch (RuntimeError& error)
+    {
+        spdlog::debug("Not folding on line {}: {}", error.token().line(), error.what());
+    }
+}
+
+void DeadBranchElimination::visitStatementIf(StatementIf& statement)
+{
+    AstRewriter::visitStatementIf(statement);
+    auto* condition = asLiteral(statement.getCondition());
+    if (condition == nullptr)
+    {
+        return;
+    }
+    if (condition->getValue().isTruthy())
+    {
+        replace(statement.takethenBranch());
+    }
+    else
+    {
+        // Removes the statement when there is no else branch
+        replace(statement.takeelseBranch());
+    }
+}
+
+void DeadBranchElimination::visitStatementWhile(StatementWhile& statement)
+{
+    AstRewriter::visitStatementWhile(statement);
+    auto* condition = asLiteral(statement.getCondition());
+    if (condition != nullptr && !condition->getValue().isTruthy())
+    {
+        remove();
+    }
+}
+
+void DeadExpressionElimination::visitStatementExpression(StatementExpression& statement)
+{
+    AstRewriter::visitStatementExpression(statement);
+    if (asLiteral(statement.getExpression()) != nullptr)
+    {
+        remove();
+    }
+}
+}  // namespace lox
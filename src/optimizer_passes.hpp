@@ -0,0 +1,46 @@
+#pragma once
+#include "interpreter.hpp"
+#include "pass_manager.hpp"
+
+namespace lox
+{
+// Evaluates operators whose operands are all literals and drops groupings. Logical operators
+// with a literal left side are reduced to the operand they would return. Operations that would
+// fail at runtime are left alone so the error is still raised when (and if) they execute.
+class ConstantFolding : public AstRewriter
+{
+public:
+    [[nodiscard]] const char* name() const override { return "constant-folding"; }
+
+    void visitExpressionBinary(ExpressionBinary& expression) override;
+    void visitExpressionGrouping(ExpressionGrouping& expression) override;
+    void visitExpressionLogical(ExpressionLogical& expression) override;
+    void visitExpressionUnary(ExpressionUnary& expression) override;
+
+private:
+    void fold(Expression& expression);
+
+    // Folding goes through the interpreter so the results match a runtime evaluation exactly
+    Interpreter m_evaluator;
+};
+
+// Replaces ifs with a literal condition by the branch that would run and removes loops whose
+// condition is a falsey literal
+class DeadBranchElimination : public AstRewriter
+{
+public:
+    [[nodiscard]] const char* name() const override { return "dead-branch-elimination"; }
+
+    void visitStatementIf(StatementIf& statement) override;
+    void visitStatementWhile(StatementWhile& statement) override;
+};
+
+// Removes expression statements that are just a literal
+class DeadExpressionElimination : public AstRewriter
+{
+public:
+    [[nodiscard]] const char* name() const override { return "dead-expression-elimination"; }
+
+    void visitStatementExpression(StatementExpression& statement) override;
+};
+}  // namespace lox
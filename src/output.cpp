@@ -0,0 +1,42 @@
+#include "output.hpp"
+
+#include <unistd.h>
+
+namespace lox
+{
+Output::Output(std::FILE* file) : m_file(file), m_line_buffered(isatty(fileno(file)) != 0)
+{
+    m_buffer.reserve(Buffer_Size);
+}
+
+Output& Output::standard()
+{
+    static Output output(stdout);
+    return output;
+}
+
+void Output::line(std::string_view text)
+{
+    if (m_buffer.size() + text.size() + 1 > Buffer_Size)
+    {
+        flush();
+    }
+    m_buffer.append(text);
+    m_buffer.push_back('\n');
+    if (m_line_buffered)
+    {
+        flush();
+    }
+}
+
+void Output::flush()
+{
+    if (m_buffer.empty())
+    {
+        return;
+    }
+    std::fwrite(m_buffer.data(), 1, m_buffer.size(), m_file);
+    std::fflush(m_file);
+    m_buffer.clear();
+}
+}  // namespace lox
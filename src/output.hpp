@@ -0,0 +1,38 @@
+#pragma once
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace lox
+{
+// Destination of print statements, kept apart from the spdlog diagnostics. Lines are gathered
+// in a large buffer and written when it fills up, on flush and on destruction. When the file
+// is a terminal every line is written as soon as it is complete.
+class Output
+{
+public:
+    static constexpr std::size_t Buffer_Size = 64 * 1024;
+
+    explicit Output(std::FILE* file);
+    ~Output() { flush(); }
+
+    // Delete undesired constructors (Not copy, move or assign)
+    Output(const Output&) = delete;
+    Output& operator=(const Output&) = delete;
+
+    // The sink for stdout, flushed when the program exits
+    static Output& standard();
+
+    // Writes text followed by a newline
+    void line(std::string_view text);
+    void flush();
+
+    [[nodiscard]] bool lineBuffered() const { return m_line_buffered; }
+
+private:
+    std::FILE* m_file;
+    bool m_line_buffered;
+    std::string m_buffer;
+};
+}  // namespace lox
@@ -3,11 +3,21 @@
 #include <spdlog/spdlog.h>
 
 #include "literal.hpp"
+#include "output.hpp"
+#include "trace.hpp"
+
 namespace lox
 {
-std::vector<std::unique_ptr<Statement>> Parser::parse()
+Parser::Parser(Scanner& scanner)
+    : m_scanner(scanner),
+      m_previous(TokenType::END_OF_FILE, std::string_view(), 1),
+      m_current(scanner.nextToken())
 {
-    std::vector<std::unique_ptr<Statement>> statements;
+}
+
+Program Parser::parse()
+{
+    auto& statements = m_program.statements();
     while (!isAtEnd())
     {
         auto dec = declaration();
@@ -16,7 +26,22 @@ std::vector<std::unique_ptr<Statement>> Parser::parse()
             statements.emplace_back(std::move(dec));
         }
     }
-    return statements;
+    return std::move(m_program);
+}
+
+Program* Parser::next()
+{
+    m_program.clear();
+    while (!isAtEnd())
+    {
+        auto dec = declaration();
+        if (dec != nullptr)
+        {
+            m_program.statements().emplace_back(std::move(dec));
+            return &m_program;
+        }
+    }
+    return nullptr;
 }
 
 void Parser::synchronize()
@@ -48,7 +73,7 @@ void Parser::synchronize()
     }
 }
 
-std::unique_ptr<Statement> Parser::declaration()
+StatementPtr Parser::declaration()
 {
     try
     {
@@ -60,14 +85,15 @@ std::unique_ptr<Statement> Parser::declaration()
     }
     catch (ParseError& error)
     {
+        m_had_error = true;
         synchronize();
         return nullptr;
     }
 }
 
-std::unique_ptr<std::vector<std::unique_ptr<Statement>>> Parser::block()
+StatementListPtr Parser::block()
 {
-    auto statements = std::make_unique<std::vector<std::unique_ptr<Statement>>>();
+    auto statements = m_program.make<StatementList>();
 
     while (!check(TokenType::RIGHT_BRACE) && !isAtEnd())
     {
@@ -78,7 +104,7 @@ std::unique_ptr<std::vector<std::unique_ptr<Statement>>> Parser::block()
     return statements;
 }
 
-std::unique_ptr<Statement> Parser::statement()
+StatementPtr Parser::statement()
 {
     if (match({TokenType::IF}))
     {
@@ -98,47 +124,48 @@ std::unique_ptr<Statement> Parser::statement()
     }
     if (match({TokenType::LEFT_BRACE}))
     {
-        return std::make_unique<StatementBlock>(block());
+        return m_program.make<StatementBlock>(block());
     }
 
     return expressionStatement();
 }
 
-std::unique_ptr<Statement> Parser::ifStatement()
+StatementPtr Parser::ifStatement()
 {
     consume(TokenType::LEFT_PAREN, "Expect '(' after 'if'.");
     auto condition = expression();
     consume(TokenType::RIGHT_PAREN, "Expect ')' after if condition.");
     auto then_branch = statement();
-    std::unique_ptr<Statement> else_branch;
+    StatementPtr else_branch{};
     if (match({TokenType::ELSE}))
     {
         else_branch = statement();
     }
-    return std::make_unique<StatementIf>(std::move(condition), std::move(then_branch),
-                                         std::move(else_branch));
+    return m_program.make<StatementIf>(std::move(condition), std::move(then_branch),
+                                      std::move(else_branch));
 }
 
-std::unique_ptr<Statement> Parser::printStatement()
+StatementPtr Parser::printStatement()
 {
+    int line = previous().line();
     auto expr = expression();
     consume(TokenType::SEMICOLON, "Expect ';' after value.");
-    return std::make_unique<StatementPrint>(std::move(expr));
+    return m_program.make<StatementPrint>(line, std::move(expr));
 }
 
-std::unique_ptr<Statement> Parser::whileStatement()
+StatementPtr Parser::whileStatement()
 {
     consume(TokenType::LEFT_PAREN, "Expect '(' after while.");
     auto expr = expression();
     consume(TokenType::RIGHT_PAREN, "Expect ')' after while.");
     auto body = statement();
-    return std::make_unique<StatementWhile>(std::move(expr), std::move(body));
+    return m_program.make<StatementWhile>(std::move(expr), std::move(body));
 }
 
-std::unique_ptr<Statement> Parser::forStatement()
+StatementPtr Parser::forStatement()
 {
     consume(TokenType::LEFT_PAREN, "Expect '(' after for.");
-    std::unique_ptr<Statement> initializer;
+    StatementPtr initializer{};
     if (match({TokenType::SEMICOLON}))
     {
         initializer = nullptr;
@@ -152,70 +179,72 @@ std::unique_ptr<Statement> Parser::forStatement()
         initializer = expressionStatement();
     }
 
-    std::unique_ptr<Expression> condition;
+    ExpressionPtr condition{};
     if (!check(TokenType::SEMICOLON))
     {
         condition = expression();
     }
     consume(TokenType::SEMICOLON, "Expect ';' after loop condition.");
 
-    std::unique_ptr<Expression> increment;
+    ExpressionPtr increment{};
     if (!check(TokenType::RIGHT_PAREN))
     {
         increment = expression();
     }
     consume(TokenType::RIGHT_PAREN, "Expect ')' after for loop clauses.");
+    int increment_line = previous().line();
 
     auto body = statement();
     if (increment != nullptr)
     {
         // Statement block is the for loop body followed by the increment
-        auto statements = std::make_unique<std::vector<std::unique_ptr<Statement>>>();
+        auto statements = m_program.make<StatementList>();
         statements->emplace_back(std::move(body));
-        statements->emplace_back(std::make_unique<StatementExpression>(std::move(increment)));
-        body = std::make_unique<StatementBlock>(std::move(statements));
+        statements->emplace_back(
+            m_program.make<StatementExpression>(increment_line, std::move(increment)));
+        body = m_program.make<StatementBlock>(std::move(statements));
     }
 
     if (condition == nullptr)
     {
-        condition = std::make_unique<ExpressionLiteral>(LiteralVal(true));
+        condition = m_program.make<ExpressionLiteral>(Value(true));
     }
 
-    body = std::make_unique<StatementWhile>(std::move(condition), std::move(body));
+    body = m_program.make<StatementWhile>(std::move(condition), std::move(body));
 
     if (initializer != nullptr)
     {
-        auto statements = std::make_unique<std::vector<std::unique_ptr<Statement>>>();
+        auto statements = m_program.make<StatementList>();
         statements->emplace_back(std::move(initializer));
         statements->emplace_back(std::move(body));
-        body = std::make_unique<StatementBlock>(std::move(statements));
+        body = m_program.make<StatementBlock>(std::move(statements));
     }
     return body;
 }
 
-std::unique_ptr<Statement> Parser::expressionStatement()
+StatementPtr Parser::expressionStatement()
 {
     auto expr = expression();
-    consume(TokenType::SEMICOLON, "Expect ';' after expression.");
-    return std::make_unique<StatementExpression>(std::move(expr));
+    int line = consume(TokenType::SEMICOLON, "Expect ';' after expression.").line();
+    return m_program.make<StatementExpression>(line, std::move(expr));
 }
 
-std::unique_ptr<Statement> Parser::varDeclaration()
+StatementPtr Parser::varDeclaration()
 {
     auto name = consume(TokenType::IDENTIFIER, "Expect variable name.");
-    std::unique_ptr<Expression> initializer;
+    ExpressionPtr initializer{};
     if (match({TokenType::EQUAL}))
     {
         initializer = expression();
     }
 
     consume(TokenType::SEMICOLON, "Expect ';' after variable declaration.");
-    return std::make_unique<StatementVariable>(name, std::move(initializer));
+    return m_program.make<StatementVariable>(name, std::move(initializer));
 }
 
-std::unique_ptr<Expression> Parser::expression() { return assignment(); }
+ExpressionPtr Parser::expression() { return assignment(); }
 
-std::unique_ptr<Expression> Parser::assignment()
+ExpressionPtr Parser::assignment()
 {
     auto expr = logicalOr();
 
@@ -224,11 +253,11 @@ std::unique_ptr<Expression> Parser::assignment()
         auto equals = previous();
         auto value = assignment();
 
-        if (auto* varexpr = dynamic_cast<ExpressionVariable*>(expr.get()))
+        if (auto* varexpr = dynamic_cast<ExpressionVariable*>(rawNode(expr)))
         {
             auto name = varexpr->getName();
-            spdlog::debug("Found expression variable {}!", name.repr());
-            return std::make_unique<ExpressionAssign>(name, std::move(value));
+            LOX_DEBUG("Found expression variable {}!", name.lexeme());
+            return m_program.make<ExpressionAssign>(name, std::move(value));
         }
 
         throw error(equals, "Invalid assignment target");
@@ -236,7 +265,7 @@ std::unique_ptr<Expression> Parser::assignment()
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::logicalOr()
+ExpressionPtr Parser::logicalOr()
 {
     auto expr = logicalAnd();
 
@@ -244,24 +273,24 @@ std::unique_ptr<Expression> Parser::logicalOr()
     {
         auto token = previous();
         auto right = logicalAnd();
-        expr = std::make_unique<ExpressionLogical>(std::move(expr), token, std::move(right));
+        expr = m_program.make<ExpressionLogical>(std::move(expr), token, std::move(right));
     }
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::logicalAnd()
+ExpressionPtr Parser::logicalAnd()
 {
     auto expr = equality();
     if (match({TokenType::AND}))
     {
         auto token = previous();
         auto right = equality();
-        expr = std::make_unique<ExpressionLogical>(std::move(expr), token, std::move(right));
+        expr = m_program.make<ExpressionLogical>(std::move(expr), token, std::move(right));
     }
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::equality()
+ExpressionPtr Parser::equality()
 {
     auto expr = comparison();
 
@@ -269,13 +298,13 @@ std::unique_ptr<Expression> Parser::equality()
     {
         auto oper = previous();
         auto right = comparison();
-        expr = std::make_unique<ExpressionBinary>(std::move(expr), oper, std::move(right));
+        expr = m_program.make<ExpressionBinary>(std::move(expr), oper, std::move(right));
     }
 
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::comparison()
+ExpressionPtr Parser::comparison()
 {
     auto expr = addition();
 
@@ -284,29 +313,29 @@ std::unique_ptr<Expression> Parser::comparison()
     {
         auto oper = previous();
         auto right = addition();
-        expr = std::make_unique<ExpressionBinary>(std::move(expr), oper, std::move(right));
+        expr = m_program.make<ExpressionBinary>(std::move(expr), oper, std::move(right));
     }
 
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::addition()
+ExpressionPtr Parser::addition()
 {
     auto expr = multiplication();
 
     while (match({TokenType::MINUS, TokenType::PLUS}))
     {
-        spdlog::debug("Combining additions...");
+        LOX_DEBUG("Combining additions...");
         auto oper = previous();
         auto right = multiplication();
-        expr = std::make_unique<ExpressionBinary>(std::move(expr), oper, std::move(right));
+        expr = m_program.make<ExpressionBinary>(std::move(expr), oper, std::move(right));
     }
 
-    spdlog::debug("Additions combined!");
+    LOX_DEBUG("Additions combined!");
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::multiplication()
+ExpressionPtr Parser::multiplication()
 {
     auto expr = unary();
 
@@ -314,60 +343,65 @@ std::unique_ptr<Expression> Parser::multiplication()
     {
         auto oper = previous();
         auto right = unary();
-        expr = std::make_unique<ExpressionBinary>(std::move(expr), oper, std::move(right));
+        expr = m_program.make<ExpressionBinary>(std::move(expr), oper, std::move(right));
     }
 
     return expr;
 }
 
-std::unique_ptr<Expression> Parser::unary()
+ExpressionPtr Parser::unary()
 {
     if (match({TokenType::BANG, TokenType::MINUS}))
     {
         auto oper = previous();
         auto right = unary();
-        return std::make_unique<ExpressionUnary>(oper, std::move(right));
+        return m_program.make<ExpressionUnary>(oper, std::move(right));
     }
 
     return primary();
 }
 
-std::unique_ptr<Expression> Parser::primary()
+ExpressionPtr Parser::primary()
 {
     if (match({TokenType::FALSE}))
     {
-        spdlog::debug("Found primary expression false");
-        return std::make_unique<ExpressionLiteral>(LiteralVal(false));
+        LOX_DEBUG("Found primary expression false");
+        return m_program.make<ExpressionLiteral>(Value(false));
     }
     if (match({TokenType::TRUE}))
     {
-        spdlog::debug("Found primary expression true");
-        return std::make_unique<ExpressionLiteral>(LiteralVal(true));
+        LOX_DEBUG("Found primary expression true");
+        return m_program.make<ExpressionLiteral>(Value(true));
     }
     if (match({TokenType::NIL}))
     {
-        spdlog::debug("Found primary expression nil");
-        return std::make_unique<ExpressionLiteral>(LiteralVal());
+        LOX_DEBUG("Found primary expression nil");
+        return m_program.make<ExpressionLiteral>(Value());
     }
 
-    if (match({TokenType::NUMBER, TokenType::STRING}))
+    if (match({TokenType::NUMBER}))
+    {
+        LOX_DEBUG("Found primary expression number {}", previous().lexeme());
+        return m_program.make<ExpressionLiteral>(Value(previous().number()));
+    }
+    if (match({TokenType::STRING}))
     {
-        spdlog::debug("Found primary expression string or number {}", previous().repr());
-        return std::make_unique<ExpressionLiteral>(previous().literal());
+        LOX_DEBUG("Found primary expression string {}", previous().lexeme());
+        return m_program.make<ExpressionLiteral>(Value::intern(previous().string()));
     }
 
     if (match({TokenType::IDENTIFIER}))
     {
-        spdlog::debug("Found primary expression identifier");
-        return std::make_unique<ExpressionVariable>(previous());
+        LOX_DEBUG("Found primary expression identifier");
+        return m_program.make<ExpressionVariable>(previous());
     }
 
     if (match({TokenType::LEFT_PAREN}))
     {
-        spdlog::debug("Found primary expression left paren");
+        LOX_DEBUG("Found primary expression left paren");
         auto expr = expression();
         consume(TokenType::RIGHT_PAREN, "Expect ')' after expression.");
-        return std::make_unique<ExpressionGrouping>(std::move(expr));
+        return m_program.make<ExpressionGrouping>(std::move(expr));
     }
 
     throw(error(peek(), "Expect expression."));
@@ -398,16 +432,17 @@ const Token& Parser::advance()
 {
     if (!isAtEnd())
     {
-        m_current++;
+        m_previous = m_current;
+        m_current = m_scanner.nextToken();
     }
     return previous();
 }
 
 bool Parser::isAtEnd() const { return peek().type() == TokenType::END_OF_FILE; }
 
-const Token& Parser::peek() const { return m_tokens.at(m_current); }
+const Token& Parser::peek() const { return m_current; }
 
-const Token& Parser::previous() const { return m_tokens.at(m_current - 1); }
+const Token& Parser::previous() const { return m_previous; }
 
 const Token& Parser::consume(TokenType type, const std::string& message)
 {
@@ -422,6 +457,8 @@ const Token& Parser::consume(TokenType type, const std::string& message)
 ParseError Parser::error(const Token& token, const std::string& message)
 {
     // TODO Feed this up to other logging function and make it like original Java
+    // Values printed by declarations that already ran in --stream mode come first
+    Output::standard().flush();
     if (token.type() == TokenType::END_OF_FILE)
     {
         spdlog::error(" line {} at end {}", token.line(), message);
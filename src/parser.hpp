@@ -3,6 +3,8 @@
 #include <vector>
 
 #include "expression_ast.hpp"
+#include "program.hpp"
+#include "scanner.hpp"
 #include "statement_ast.hpp"
 #include "token.hpp"
 
@@ -11,35 +13,45 @@ namespace lox
 class Parser
 {
 public:
-    explicit Parser(std::vector<Token>&& tokens) : m_tokens(tokens) {}
+    // Tokens are pulled from the scanner as the parser needs them, one at a time
+    explicit Parser(Scanner& scanner);
 
-    std::vector<std::unique_ptr<Statement>> parse();
+    // Builds the whole token stream into a Program, can only be called once
+    Program parse();
+
+    // Streaming alternative to parse(): builds the next top level declaration into a Program of
+    // its own and returns it, or nullptr at the end of the stream. The Program is owned by the
+    // parser and reused, so the previous one is freed by the next call.
+    Program* next();
+
+    // True once a syntax error has been reported
+    [[nodiscard]] bool hadError() const { return m_had_error; }
 
 private:
     void synchronize();
 
-    std::unique_ptr<std::vector<std::unique_ptr<Statement>>> block();
-    std::unique_ptr<Statement> declaration();
-
-    std::unique_ptr<Statement> statement();
-    std::unique_ptr<Statement> ifStatement();
-    std::unique_ptr<Statement> printStatement();
-    std::unique_ptr<Statement> whileStatement();
-    std::unique_ptr<Statement> forStatement();
-    std::unique_ptr<Statement> expressionStatement();
-    std::unique_ptr<Statement> varDeclaration();
-
-    std::unique_ptr<Expression> expression();
-
-    std::unique_ptr<Expression> assignment();
-    std::unique_ptr<Expression> equality();
-    std::unique_ptr<Expression> logicalOr();
-    std::unique_ptr<Expression> logicalAnd();
-    std::unique_ptr<Expression> comparison();
-    std::unique_ptr<Expression> addition();
-    std::unique_ptr<Expression> multiplication();
-    std::unique_ptr<Expression> unary();
-    std::unique_ptr<Expression> primary();
+    StatementListPtr block();
+    StatementPtr declaration();
+
+    StatementPtr statement();
+    StatementPtr ifStatement();
+    StatementPtr printStatement();
+    StatementPtr whileStatement();
+    StatementPtr forStatement();
+    StatementPtr expressionStatement();
+    StatementPtr varDeclaration();
+
+    ExpressionPtr expression();
+
+    ExpressionPtr assignment();
+    ExpressionPtr equality();
+    ExpressionPtr logicalOr();
+    ExpressionPtr logicalAnd();
+    ExpressionPtr comparison();
+    ExpressionPtr addition();
+    ExpressionPtr multiplication();
+    ExpressionPtr unary();
+    ExpressionPtr primary();
     bool match(const std::vector<TokenType>&& types);
     bool check(TokenType type);
 
@@ -51,7 +63,10 @@ private:
 
     static ParseError error(const Token& token, const std::string& message);
 
-    const std::vector<Token> m_tokens;
-    int m_current = 0;
+    Scanner& m_scanner;
+    Token m_previous;
+    Token m_current;
+    Program m_program;
+    bool m_had_error{false};
 };
 }  // namespace lox
@@ -0,0 +1,159 @@
+#include "pass_manager.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <utility>
+
+#include "optimizer_passes.hpp"
+
+namespace lox
+{
+PassManager PassManager::defaultPipeline()
+{
+    PassManager manager;
+    manager.add(std::make_unique<ConstantFolding>());
+    manager.add(std::make_unique<DeadBranchElimination>());
+    manager.add(std::make_unique<DeadExpressionElimination>());
+    return manager;
+}
+
+void PassManager::run(Program& program)
+{
+    for (auto& pass : m_passes)
+    {
+        spdlog::debug("Running pass {}", pass->name());
+        pass->run(program);
+    }
+}
+
+void AstRewriter::run(Program& program)
+{
+    m_program = &program;
+    rewrite(program.statements());
+    m_program = nullptr;
+}
+
+ExpressionPtr AstRewriter::rewrite(ExpressionPtr expression)
+{
+    if (expression == nullptr)
+    {
+        return expression;
+    }
+    expression->accept(*this);
+    if (m_expression != nullptr)
+    {
+        return std::exchange(m_expression, nullptr);
+    }
+    return expression;
+}
+
+StatementPtr AstRewriter::rewrite(StatementPtr statement)
+{
+    if (statement == nullptr)
+    {
+        return statement;
+    }
+    statement->accept(*this);
+    if (m_replaced)
+    {
+        m_replaced = false;
+        return std::exchange(m_statement, nullptr);
+    }
+    return statement;
+}
+
+void AstRewriter::rewrite(StatementList& statements)
+{
+    std::size_t kept = 0;
+    for (auto& statement : statements)
+    {
+        // Statements that failed to parse stay, the engines report them
+        if (statement == nullptr)
+        {
+            statements[kept++] = std::move(statement);
+            continue;
+        }
+        auto result = rewrite(std::move(statement));
+        if (result != nullptr)
+        {
+            statements[kept++] = std::move(result);
+        }
+    }
+    statements.resize(kept);
+}
+
+void AstRewriter::visitExpressionAssign(ExpressionAssign& expression)
+{
+    expression.setValue(rewrite(expression.takeValue()));
+}
+
+void AstRewriter::visitExpressionBinary(ExpressionBinary& expression)
+{
+    expression.setLeft(rewrite(expression.takeLeft()));
+    expression.setRight(rewrite(expression.takeRight()));
+}
+
+void AstRewriter::visitExpressionGrouping(ExpressionGrouping& expression)
+{
+    expression.setExpression(rewrite(expression.takeExpression()));
+}
+
+void AstRewriter::visitExpressionLiteral(ExpressionLiteral& /*expression*/) {}
+
+void AstRewriter::visitExpressionLogical(ExpressionLogical& expression)
+{
+    expression.setLeft(rewrite(expression.takeLeft()));
+    expression.setRight(rewrite(expression.takeRight()));
+}
+
+void AstRewriter::visitExpressionUnary(ExpressionUnary& expression)
+{
+    expression.setExpression(rewrite(expression.takeExpression()));
+}
+
+void AstRewriter::visitExpressionVariable(ExpressionVariable& /*expression*/) {}
+
+void AstRewriter::visitStatementBlock(StatementBlock& statement)
+{
+    rewrite(*statement.getStatements());
+}
+
+void AstRewriter::visitStatementExpression(StatementExpression& statement)
+{
+    statement.setExpression(rewrite(statement.takeExpression()));
+}
+
+void AstRewriter::visitStatementIf(StatementIf& statement)
+{
+    statement.setCondition(rewrite(statement.takeCondition()));
+    auto then_branch = rewrite(statement.takethenBranch());
+    if (then_branch == nullptr)
+    {
+        // The engines expect a then branch, an empty block does nothing
+        then_branch = program().make<StatementBlock>(program().make<StatementList>());
+    }
+    statement.setthenBranch(std::move(then_branch));
+    statement.setelseBranch(rewrite(statement.takeelseBranch()));
+}
+
+void AstRewriter::visitStatementPrint(StatementPrint& statement)
+{
+    statement.setExpression(rewrite(statement.takeExpression()));
+}
+
+void AstRewriter::visitStatementVariable(StatementVariable& statement)
+{
+    statement.setInitializer(rewrite(statement.takeInitializer()));
+}
+
+void AstRewriter::visitStatementWhile(StatementWhile& statement)
+{
+    statement.setCondition(rewrite(statement.takeCondition()));
+    auto body = rewrite(statement.takeBody());
+    if (body == nullptr)
+    {
+        body = program().make<StatementBlock>(program().make<StatementList>());
+    }
+    statement.setBody(std::move(body));
+}
+}  // namespace lox
@@ -0,0 +1,84 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "expression_ast.hpp"
+#include "program.hpp"
+#include "statement_ast.hpp"
+
+namespace lox
+{
+// A transformation over a whole parsed program, run before the resolver
+class Pass
+{
+public:
+    Pass() = default;
+    Pass(const Pass&) = delete;
+    Pass& operator=(const Pass&) = delete;
+    virtual ~Pass() = default;
+
+    [[nodiscard]] virtual const char* name() const = 0;
+    virtual void run(Program& program) = 0;
+};
+
+// Runs its passes in the order they were added
+class PassManager
+{
+public:
+    // The optimizations every program goes through
+    static PassManager defaultPipeline();
+
+    void add(std::unique_ptr<Pass> pass) { m_passes.push_back(std::move(pass)); }
+    void run(Program& program);
+
+private:
+    std::vector<std::unique_ptr<Pass>> m_passes;
+};
+
+// Base for passes that replace nodes. Every child slot is detached, rewritten and put back, so
+// a visit may hand back a different node with replace() or drop a statement with remove().
+// The default visits only recurse, subclasses override the nodes they care about.
+class AstRewriter : public Pass, public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    void run(Program& program) override;
+
+    void visitExpressionAssign(ExpressionAssign& expression) override;
+    void visitExpressionBinary(ExpressionBinary& expression) override;
+    void visitExpressionGrouping(ExpressionGrouping& expression) override;
+    void visitExpressionLiteral(ExpressionLiteral& expression) override;
+    void visitExpressionLogical(ExpressionLogical& expression) override;
+    void visitExpressionUnary(ExpressionUnary& expression) override;
+    void visitExpressionVariable(ExpressionVariable& expression) override;
+
+    void visitStatementBlock(StatementBlock& statement) override;
+    void visitStatementExpression(StatementExpression& statement) override;
+    void visitStatementIf(StatementIf& statement) override;
+    void visitStatementPrint(StatementPrint& statement) override;
+    void visitStatementVariable(StatementVariable& statement) override;
+    void visitStatementWhile(StatementWhile& statement) override;
+
+protected:
+    ExpressionPtr rewrite(ExpressionPtr expression);
+    StatementPtr rewrite(StatementPtr statement);
+    // Rewrites a statement list in place, removed statements are erased
+    void rewrite(StatementList& statements);
+
+    // Called from a visit to put another node in place of the one being visited
+    void replace(ExpressionPtr expression) { m_expression = std::move(expression); }
+    void replace(StatementPtr statement)
+    {
+        m_statement = std::move(statement);
+        m_replaced = true;
+    }
+    void remove() { replace(StatementPtr{}); }
+
+    [[nodiscard]] Program& program() { return *m_program; }
+
+private:
+    Program* m_program{nullptr};
+    ExpressionPtr m_expression{};
+    StatementPtr m_statement{};
+    bool m_replaced{false};
+};
+}  // namespace lox
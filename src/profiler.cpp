@@ -0,0 +1,263 @@
+#include "profiler.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <sys/time.h>
+
+namespace lox
+{
+namespace
+{
+constexpr int Interval_Microseconds = 1000;
+// Hot lines logged by report()
+constexpr std::size_t Report_Lines = 20;
+
+// Samples back to back, each its depth followed by that many lines. Only written by the signal
+// handler while the profiler runs.
+std::vector<int> samples;
+std::size_t used = 0;
+std::size_t dropped = 0;
+
+// Lines of the statements the frames push. Print and expression statements carry the line the
+// parser gave them, conditions take the line of their first token, or of the statement before
+// them if they have none (`while (true)`).
+class LineAnnotator : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    void annotate(Statement* statement)
+    {
+        if (statement != nullptr)
+        {
+            statement->accept(*this);
+        }
+    }
+
+private:
+    // Line of the first token of expression, or of the last statement if it has none
+    int lineOf(Expression* expression)
+    {
+        m_found = 0;
+        if (expression != nullptr)
+        {
+            expression->accept(*this);
+        }
+        if (m_found != 0)
+        {
+            m_line = m_found;
+        }
+        return m_line;
+    }
+    void find(Expression* expression)
+    {
+        if (m_found == 0 && expression != nullptr)
+        {
+            expression->accept(*this);
+        }
+    }
+    void find(const Token& token)
+    {
+        if (m_found == 0)
+        {
+            m_found = token.line();
+        }
+    }
+
+    void visitStatementBlock(StatementBlock& statement) override
+    {
+        if (statement.getStatements() != nullptr)
+        {
+            for (auto& inner : *statement.getStatements())
+            {
+                annotate(rawNode(inner));
+            }
+        }
+    }
+    void visitStatementExpression(StatementExpression& statement) override
+    {
+        m_line = statement.getLine();
+    }
+    void visitStatementIf(StatementIf& statement) override
+    {
+        statement.setLine(lineOf(statement.getCondition()));
+        annotate(statement.getthenBranch());
+        annotate(statement.getelseBranch());
+    }
+    void visitStatementPrint(StatementPrint& statement) override
+    {
+        m_line = statement.getLine();
+    }
+    void visitStatementWhile(StatementWhile& statement) override
+    {
+        statement.setLine(lineOf(statement.getCondition()));
+        annotate(statement.getBody());
+    }
+    void visitStatementVariable(StatementVariable& statement) override
+    {
+        m_line = statement.getName().line();
+    }
+
+    void visitExpressionAssign(ExpressionAssign& expression) override
+    {
+        find(expression.getName());
+    }
+    void visitExpressionBinary(ExpressionBinary& expression) override
+    {
+        find(expression.getLeft());
+        find(expression.getToken());
+    }
+    void visitExpressionLogical(ExpressionLogical& expression) override
+    {
+        find(expression.getLeft());
+        find(expression.getToken());
+    }
+    void visitExpressionGrouping(ExpressionGrouping& expression) override
+    {
+        find(expression.getExpression());
+    }
+    void visitExpressionLiteral(ExpressionLiteral& /*expression*/) override {}
+    void visitExpressionUnary(ExpressionUnary& expression) override
+    {
+        find(expression.getToken());
+    }
+    void visitExpressionVariable(ExpressionVariable& expression) override
+    {
+        find(expression.getName());
+    }
+
+    int m_line{1};
+    int m_found{0};
+};
+
+std::string frameName(const std::string& script, int line)
+{
+    return fmt::format("{}:{}", script, line);
+}
+}  // namespace
+
+void Profiler::annotate(Program& program)
+{
+    LineAnnotator annotator;
+    for (auto& statement : program.statements())
+    {
+        annotator.annotate(rawNode(statement));
+    }
+}
+
+bool Profiler::start()
+{
+    samples.assign(Buffer_Size, 0);
+    used = 0;
+    dropped = 0;
+
+    struct sigaction action
+    {
+    };
+    action.sa_handler = &Profiler::sample;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    itimerval timer{};
+    timer.it_interval.tv_usec = Interval_Microseconds;
+    timer.it_value.tv_usec = Interval_Microseconds;
+    if (sigaction(SIGPROF, &action, nullptr) != 0 || setitimer(ITIMER_PROF, &timer, nullptr) != 0)
+    {
+        return false;
+    }
+    s_running = true;
+    return true;
+}
+
+void Profiler::stop()
+{
+    itimerval timer{};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+    // A signal already on its way must not kill the process
+    std::signal(SIGPROF, SIG_IGN);
+    s_running = false;
+}
+
+void Profiler::sample(int /*signal*/)
+{
+    int depth = std::min(static_cast<int>(s_depth), Max_Depth);
+    int statement = s_statement;
+    if (used + depth + 2 > samples.size())
+    {
+        dropped++;
+        return;
+    }
+    samples[used++] = depth + (statement != 0 ? 1 : 0);
+    for (int i = 0; i < depth; i++)
+    {
+        samples[used++] = s_stack[i];
+    }
+    if (statement != 0)
+    {
+        samples[used++] = statement;
+    }
+}
+
+void Profiler::report(const std::string& script, const std::string& folded_path)
+{
+    std::map<int, std::size_t> self;
+    std::map<int, std::size_t> total;
+    std::map<std::string, std::size_t> stacks;
+    std::size_t count = 0;
+    for (std::size_t at = 0; at < used; count++)
+    {
+        int depth = samples[at++];
+        std::string stack = depth == 0 ? script + ":(no statement)" : "";
+        std::set<int> lines;
+        for (int i = 0; i < depth; i++)
+        {
+            int line = samples[at++];
+            stack += (i == 0 ? "" : ";") + frameName(script, line);
+            lines.insert(line);
+        }
+        stacks[stack]++;
+        if (depth > 0)
+        {
+            self[samples[at - 1]]++;
+        }
+        // A line on the stack more than once (a nested loop on one line) is counted once
+        for (int line : lines)
+        {
+            total[line]++;
+        }
+    }
+
+    // The kernel may deliver the timer less often than asked, so no time is derived from counts
+    spdlog::info("Profile: {} samples, {} dropped", count, dropped);
+    spdlog::info("Profile: hot loops ran interpreted, the Jit is off while profiling");
+    std::vector<std::pair<int, std::size_t>> hot(self.begin(), self.end());
+    std::stable_sort(hot.begin(), hot.end(),
+                     [](const auto& a, const auto& b) { return a.second > b.second; });
+    if (hot.size() > Report_Lines)
+    {
+        hot.resize(Report_Lines);
+    }
+    spdlog::info("Profile: {:>8} {:>8} {:>8}", "line", "self", "total");
+    for (const auto& [line, samples_on_top] : hot)
+    {
+        spdlog::info("Profile: {:>8} {:>7.1f}% {:>7.1f}%", line,
+                     100.0 * static_cast<double>(samples_on_top) / static_cast<double>(count),
+                     100.0 * static_cast<double>(total[line]) / static_cast<double>(count));
+    }
+
+    std::ofstream folded(folded_path);
+    for (const auto& [stack, samples_of_stack] : stacks)
+    {
+        folded << stack << ' ' << samples_of_stack << '\n';
+    }
+    if (!folded)
+    {
+        spdlog::error("Cannot write folded stacks to {}", folded_path);
+        return;
+    }
+    spdlog::info("Profile: folded stacks written to {}", folded_path);
+}
+}  // namespace lox
@@ -0,0 +1,99 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <cstddef>
+#include <string>
+
+#include "program.hpp"
+
+namespace lox
+{
+// Sampling profiler behind --profile. The Interpreter keeps a stack of the lines of the if and
+// while statements it is in plus the line of the simple statement being executed, a SIGPROF
+// timer copies them every millisecond of CPU time. Nothing is recorded until start(), so the
+// hooks stay compiled in.
+class Profiler
+{
+public:
+    // Statements nested deeper than this are charged to their ancestor at this depth
+    static constexpr int Max_Depth = 64;
+    // Room for the samples, stacks included, taken before the buffer is full
+    static constexpr std::size_t Buffer_Size = std::size_t{1} << 22;
+
+    // An if or while statement in progress
+    class Frame
+    {
+    public:
+        explicit Frame(int line) : m_active(s_running)
+        {
+            if (m_active)
+            {
+                push(line);
+            }
+        }
+        ~Frame()
+        {
+            if (m_active)
+            {
+                pop();
+            }
+        }
+
+        // Delete undesired constructors (Not copy, move or assign)
+        Frame(const Frame&) = delete;
+        Frame& operator=(const Frame&) = delete;
+
+    private:
+        bool m_active;
+    };
+
+    // Marks the simple statement being executed, 0 when back in the enclosing frame (at the
+    // condition of a loop, say). A single store as it runs for most statements.
+    static void statement(int line)
+    {
+        if (s_running)
+        {
+            s_statement = line;
+        }
+    }
+
+    // Sets the Line annotation of if and while statements, the parser sets the others
+    static void annotate(Program& program);
+
+    // Returns false if the timer could not be set up
+    static bool start();
+    static void stop();
+    // The Jit is off while this is true, a native loop would hide the lines of its body
+    static bool running() { return s_running; }
+
+    // Logs the lines by samples taken while they were on top of the stack and writes every
+    // distinct stack with its count, one per line, to folded_path for flamegraph tools
+    static void report(const std::string& script, const std::string& folded_path);
+
+private:
+    static void push(int line)
+    {
+        if (s_depth < Max_Depth)
+        {
+            s_stack[s_depth] = line;
+        }
+        // The signal handler runs on this thread, it must see the line before the new depth
+        std::atomic_signal_fence(std::memory_order_release);
+        s_depth = s_depth + 1;
+        s_statement = 0;
+    }
+    static void pop()
+    {
+        s_depth = s_depth - 1;
+        s_statement = 0;
+    }
+
+    static void sample(int signal);
+
+    inline static bool s_running{false};
+    inline static std::array<int, Max_Depth> s_stack{};
+    inline static volatile std::sig_atomic_t s_depth{0};
+    inline static volatile std::sig_atomic_t s_statement{0};
+};
+}  // namespace lox
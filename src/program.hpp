@@ -0,0 +1,70 @@
+#pragma once
+#include <memory>
+#include <type_traits>
+#include <utility>
+
+#include "arena.hpp"
+#include "expression_ast.hpp"
+#include "source_buffer.hpp"
+#include "stats.hpp"
+#include "statement_ast.hpp"
+
+namespace lox
+{
+// A parsed program: its top level statements and, when astGen runs in arena mode, the arena
+// every node was allocated from. Dropping the Program frees the whole tree at once.
+// Tokens in the tree view the source text, which the Program can keep alive with retain().
+class Program
+{
+public:
+    Program() = default;
+    Program(Program&&) noexcept = default;
+    Program& operator=(Program&&) noexcept = default;
+    ~Program() = default;
+
+    // Delete undesired constructors (Allow move, not copy or assign)
+    Program(const Program&) = delete;
+    Program& operator=(const Program&) = delete;
+
+    // Creates a node (or StatementList) owned by this program. Returns a plain pointer in arena
+    // mode and a std::unique_ptr otherwise, either converts to ExpressionPtr/StatementPtr.
+    template <typename T, typename... Args>
+    auto make(Args&&... args)
+    {
+        if constexpr (!std::is_same_v<T, StatementList>)
+        {
+            Stats::countNode();
+        }
+        if constexpr (Ast_Arena)
+        {
+            return m_arena.create<T>(std::forward<Args>(args)...);
+        }
+        else
+        {
+            return std::make_unique<T>(std::forward<Args>(args)...);
+        }
+    }
+
+    [[nodiscard]] StatementList& statements() { return m_statements; }
+
+    // Drops every statement, keeping some of the arena memory around for the next ones
+    void clear()
+    {
+        m_statements.clear();
+        m_arena.reset();
+    }
+
+    [[nodiscard]] const Arena& arena() const { return m_arena; }
+    // Also holds objects tied to the nodes, such as their compiled loops
+    [[nodiscard]] Arena& arena() { return m_arena; }
+
+    void retain(std::shared_ptr<const SourceBuffer> source) { m_source = std::move(source); }
+    [[nodiscard]] const SourceBuffer* source() const { return m_source.get(); }
+
+private:
+    std::shared_ptr<const SourceBuffer> m_source;
+    // Declared first so the statements are destroyed before the memory they live in
+    Arena m_arena;
+    StatementList m_statements;
+};
+}  // namespace lox
@@ -0,0 +1,184 @@
+#include "resolver.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+#include "trace.hpp"
+
+namespace lox
+{
+void Resolver::resolve(Program& program)
+{
+    for (auto& statement : program.statements())
+    {
+        resolve(rawNode(statement));
+    }
+}
+
+void Resolver::forgetGlobals(int defined)
+{
+    auto& globals = m_scopes.front();
+    for (auto global = globals.begin(); global != globals.end();)
+    {
+        if (global->second >= defined)
+        {
+            LOX_DEBUG("Forgetting global {} slot {}", global->first, global->second);
+            global = globals.erase(global);
+        }
+        else
+        {
+            global++;
+        }
+    }
+}
+
+void Resolver::resolve(Statement* statement)
+{
+    if (statement != nullptr)
+    {
+        statement->accept(*this);
+    }
+}
+
+void Resolver::resolve(Expression* expression)
+{
+    if (expression != nullptr)
+    {
+        expression->accept(*this);
+    }
+}
+
+int Resolver::declare(const Token& name)
+{
+    auto& scope = m_scopes.back();
+    // Redeclaring a name in the same scope reuses its slot
+    auto result = scope.emplace(std::string(name.lexeme()), static_cast<int>(scope.size()));
+    LOX_DEBUG("Declared {} in scope {} slot {}", name.lexeme(), m_scopes.size() - 1,
+              result.first->second);
+    return result.first->second;
+}
+
+bool Resolver::resolveLocal(const Token& name, int& depth, int& slot) const
+{
+    const auto lexeme = name.lexeme();
+    for (auto scope = m_scopes.rbegin(); scope != m_scopes.rend(); scope++)
+    {
+        auto found = scope->find(lexeme);
+        if (found != scope->end())
+        {
+            depth = static_cast<int>(std::distance(m_scopes.rbegin(), scope));
+            slot = found->second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void Resolver::visitStatementBlock(StatementBlock& statement)
+{
+    auto* statements = statement.getStatements();
+    if (statements == nullptr)
+    {
+        statement.setScoped(false);
+        return;
+    }
+
+    // Declarations can only appear directly in a block, any other statement that holds
+    // statements is a branch or loop body which cannot declare, so only this level is checked
+    bool declares = std::any_of(statements->begin(), statements->end(), [](const auto& inner) {
+        return dynamic_cast<StatementVariable*>(rawNode(inner)) != nullptr;
+    });
+    // Blocks that declare nothing run in the enclosing environment and add no scope level
+    statement.setScoped(declares);
+    if (declares)
+    {
+        beginScope();
+    }
+    for (auto& inner : *statements)
+    {
+        resolve(rawNode(inner));
+    }
+    if (declares)
+    {
+        endScope();
+    }
+}
+
+void Resolver::visitStatementExpression(StatementExpression& statement)
+{
+    resolve(statement.getExpression());
+}
+
+void Resolver::visitStatementIf(StatementIf& statement)
+{
+    resolve(statement.getCondition());
+    resolve(statement.getthenBranch());
+    resolve(statement.getelseBranch());
+}
+
+void Resolver::visitStatementPrint(StatementPrint& statement)
+{
+    resolve(statement.getExpression());
+}
+
+void Resolver::visitStatementWhile(StatementWhile& statement)
+{
+    resolve(statement.getCondition());
+    resolve(statement.getBody());
+}
+
+void Resolver::visitStatementVariable(StatementVariable& statement)
+{
+    // The initializer is resolved first so it sees any outer variable of the same name
+    resolve(statement.getInitializer());
+    statement.setSlot(declare(statement.getName()));
+}
+
+void Resolver::visitExpressionAssign(ExpressionAssign& expression)
+{
+    resolve(expression.getValue());
+    int depth{-1};
+    int slot{0};
+    if (resolveLocal(expression.getName(), depth, slot))
+    {
+        expression.setDepth(depth);
+        expression.setSlot(slot);
+    }
+}
+
+void Resolver::visitExpressionBinary(ExpressionBinary& expression)
+{
+    resolve(expression.getLeft());
+    resolve(expression.getRight());
+}
+
+void Resolver::visitExpressionLogical(ExpressionLogical& expression)
+{
+    resolve(expression.getLeft());
+    resolve(expression.getRight());
+}
+
+void Resolver::visitExpressionGrouping(ExpressionGrouping& expression)
+{
+    resolve(expression.getExpression());
+}
+
+void Resolver::visitExpressionLiteral(ExpressionLiteral& expression) { (void)expression; }
+
+void Resolver::visitExpressionUnary(ExpressionUnary& expression)
+{
+    resolve(expression.getExpression());
+}
+
+void Resolver::visitExpressionVariable(ExpressionVariable& expression)
+{
+    int depth{-1};
+    int slot{0};
+    if (resolveLocal(expression.getName(), depth, slot))
+    {
+        expression.setDepth(depth);
+        expression.setSlot(slot);
+    }
+}
+}  // namespace lox
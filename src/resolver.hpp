@@ -0,0 +1,56 @@
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "expression_ast.hpp"
+#include "program.hpp"
+#include "statement_ast.hpp"
+
+namespace lox
+{
+// Static pass run between parsing and interpretation. Every variable use is annotated with
+// how many environments up its declaration lives (depth) and its index there (slot).
+// The global scope is kept between calls to resolve so the prompt can refer back to
+// variables declared on earlier lines.
+class Resolver : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    Resolver() : m_scopes(1) {}
+
+    void resolve(Program& program);
+    // Forgets the globals declared from slot defined on. Called when a program failed before
+    // defining them, so the next prompt line finds them undefined instead of reading nil.
+    void forgetGlobals(int defined);
+
+private:
+    void resolve(Statement* statement);
+    void resolve(Expression* expression);
+
+    void beginScope() { m_scopes.emplace_back(); }
+    void endScope() { m_scopes.pop_back(); }
+
+    int declare(const Token& name);
+    // Returns false if the name is not declared in any enclosing scope
+    bool resolveLocal(const Token& name, int& depth, int& slot) const;
+
+    void visitStatementBlock(StatementBlock& statement) override;
+    void visitStatementExpression(StatementExpression& statement) override;
+    void visitStatementIf(StatementIf& statement) override;
+    void visitStatementPrint(StatementPrint& statement) override;
+    void visitStatementWhile(StatementWhile& statement) override;
+    void visitStatementVariable(StatementVariable& statement) override;
+
+    void visitExpressionAssign(ExpressionAssign& expression) override;
+    void visitExpressionBinary(ExpressionBinary& expression) override;
+    void visitExpressionLogical(ExpressionLogical& expression) override;
+    void visitExpressionGrouping(ExpressionGrouping& expression) override;
+    void visitExpressionLiteral(ExpressionLiteral& expression) override;
+    void visitExpressionUnary(ExpressionUnary& expression) override;
+    void visitExpressionVariable(ExpressionVariable& expression) override;
+
+    // Innermost scope is at the back, the global scope is always at the front
+    std::vector<std::map<std::string, int, std::less<>>> m_scopes;
+};
+}  // namespace lox
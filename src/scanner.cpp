@@ -2,25 +2,172 @@
 
 #include <spdlog/spdlog.h>
 
+#include <array>
+#include <charconv>
+#include <cstdint>
 #include <string>
 
 #include "application.hpp"
+#include "simd_scan.hpp"
+#include "stats.hpp"
+#include "trace.hpp"
 
 namespace lox
 {
-Scanner::Scanner(const std::string& source) : m_source(source) {}
+namespace
+{
+// Character classes are looked up in a table built at compile time, this avoids the locale
+// dependent <cctype> functions on the hot path.
+enum CharClass : std::uint8_t
+{
+    Char_Digit = 1 << 0,
+    Char_Alpha = 1 << 1,
+};
+
+constexpr std::array<std::uint8_t, 256> makeCharClasses()
+{
+    std::array<std::uint8_t, 256> classes{};
+    for (int c = '0'; c <= '9'; c++)
+    {
+        classes[c] |= Char_Digit;
+    }
+    for (int c = 'a'; c <= 'z'; c++)
+    {
+        classes[c] |= Char_Alpha;
+    }
+    for (int c = 'A'; c <= 'Z'; c++)
+    {
+        classes[c] |= Char_Alpha;
+    }
+    return classes;
+}
+
+constexpr auto Char_Classes = makeCharClasses();
+
+constexpr bool hasClass(char c, std::uint8_t mask)
+{
+    return (Char_Classes[static_cast<unsigned char>(c)] & mask) != 0;
+}
+constexpr bool isDigit(char c) { return hasClass(c, Char_Digit); }
+constexpr bool isAlpha(char c) { return hasClass(c, Char_Alpha); }
+constexpr bool isAlphaNumeric(char c) { return hasClass(c, Char_Digit | Char_Alpha); }
+
+constexpr TokenType checkKeyword(std::string_view text, std::string_view keyword, TokenType type)
+{
+    return text == keyword ? type : TokenType::IDENTIFIER;
+}
 
-std::vector<Token>& Scanner::scanTokens()
+// Keywords are told apart by their first character (and second where that is ambiguous), so each
+// identifier costs at most one string comparison.
+constexpr TokenType keywordType(std::string_view text)
+{
+    if (text.size() < 2)
+    {
+        return TokenType::IDENTIFIER;
+    }
+    switch (text[0])
+    {
+    case 'a':
+        return checkKeyword(text, "and", TokenType::AND);
+    case 'c':
+        return checkKeyword(text, "class", TokenType::CLASS);
+    case 'e':
+        return checkKeyword(text, "else", TokenType::ELSE);
+    case 'f':
+        switch (text[1])
+        {
+        case 'a':
+            return checkKeyword(text, "false", TokenType::FALSE);
+        case 'o':
+            return checkKeyword(text, "for", TokenType::FOR);
+        case 'u':
+            return checkKeyword(text, "fun", TokenType::FUN);
+        default:
+            return TokenType::IDENTIFIER;
+        }
+    case 'i':
+        return checkKeyword(text, "if", TokenType::IF);
+    case 'n':
+        return checkKeyword(text, "nil", TokenType::NIL);
+    case 'o':
+        return checkKeyword(text, "or", TokenType::OR);
+    case 'p':
+        return checkKeyword(text, "print", TokenType::PRINT);
+    case 'r':
+        return checkKeyword(text, "return", TokenType::RETURN);
+    case 's':
+        return checkKeyword(text, "super", TokenType::SUPER);
+    case 't':
+        switch (text[1])
+        {
+        case 'h':
+            return checkKeyword(text, "this", TokenType::THIS);
+        case 'r':
+            return checkKeyword(text, "true", TokenType::TRUE);
+        default:
+            return TokenType::IDENTIFIER;
+        }
+    case 'v':
+        return checkKeyword(text, "var", TokenType::VAR);
+    case 'w':
+        return checkKeyword(text, "while", TokenType::WHILE);
+    default:
+        return TokenType::IDENTIFIER;
+    }
+}
+
+static_assert(keywordType("while") == TokenType::WHILE);
+static_assert(keywordType("fun") == TokenType::FUN);
+static_assert(keywordType("this") == TokenType::THIS);
+static_assert(keywordType("thistle") == TokenType::IDENTIFIER);
+static_assert(keywordType("f") == TokenType::IDENTIFIER);
+}  // namespace
+
+Scanner::Scanner(std::string_view source) : m_source(source)
+{
+    spdlog::debug("Scanning with the {} kernels", simd::kernelName());
+}
+
+Token Scanner::nextToken()
+{
+    if (m_next_ahead < m_ahead.size())
+    {
+        return m_ahead[m_next_ahead++];
+    }
+    return scanNext();
+}
+
+void Scanner::scanAhead()
+{
+    m_ahead = scanTokens();
+    m_next_ahead = 0;
+}
+
+Token Scanner::scanNext()
 {
     while (!isAtEnd())
     {
         m_start = m_current;
         scanToken();
-    };
+        if (m_token)
+        {
+            Stats::countToken();
+            auto token = *m_token;
+            m_token.reset();
+            return token;
+        }
+    }
+    return Token{TokenType::END_OF_FILE, std::string_view(), m_line};
+}
 
-    m_tokens.emplace_back(
-        Token{TokenType::END_OF_FILE, std::string(), std::make_unique<LiteralVal>(), m_line});
-    return m_tokens;
+std::vector<Token> Scanner::scanTokens()
+{
+    std::vector<Token> tokens;
+    do
+    {
+        tokens.push_back(nextToken());
+    } while (tokens.back().type() != TokenType::END_OF_FILE);
+    return tokens;
 }
 
 bool Scanner::isAtEnd() { return m_current >= (int)m_source.length(); }
@@ -76,10 +223,7 @@ void Scanner::scanToken()
         if (match('/'))
         {
             // A comment goes until the end of the line.
-            while (peek() != '\n' && !isAtEnd())
-            {
-                advance();
-            }
+            m_current = static_cast<int>(simd::findNewline(m_source, m_current));
         }
         else
         {
@@ -92,24 +236,23 @@ void Scanner::scanToken()
     case ' ':
     case '\r':
     case '\t':
-        // Ignore whitespace.
-        break;
-
     case '\n':
-        m_line++;
+        // Ignore whitespace, the whole run at once.
+        m_current = static_cast<int>(simd::skipWhitespace(m_source, m_current - 1, m_line));
         break;
     default:
-        if (std::isdigit(c) != 0)
+        if (isDigit(c))
         {
             number();
         }
-        else if (std::isalpha(c) != 0)
+        else if (isAlpha(c))
         {
             identifier();
         }
         else
         {
             Application::error(m_line, "Unexpected character");
+            m_had_error = true;
         }
         break;
     }
@@ -118,42 +261,23 @@ void Scanner::scanToken()
 char Scanner::advance()
 {
     m_current++;
-    return m_source.at(m_current - 1);
+    return m_source[m_current - 1];
 }
 
 void Scanner::addToken(TokenType type)
 {
     auto text = m_source.substr(m_start, m_current - m_start);
-    spdlog::debug("Adding a token with lexeme {} literal N/A start {} current {}", text, m_start,
-                  m_current);
-    m_tokens.emplace_back(Token{type, text, std::make_unique<LiteralVal>(), m_line});
-}
-
-void Scanner::addToken(TokenType type, std::string& literal)
-{
-    auto text = m_source.substr(m_start, m_current - m_start);
-    spdlog::debug("Adding a token with lexeme {} literal {} start {} current {}", text, literal,
-                  m_start, m_current);
-    m_tokens.emplace_back(
-        Token{type, std::move(text), std::make_unique<LiteralVal>(literal), m_line});
-}
-
-void Scanner::addToken(TokenType type, bool literal)
-{
-    auto text = m_source.substr(m_start, m_current - m_start);
-    spdlog::debug("Adding a token with lexeme {} literal {} start {} current {}", text, literal,
-                  m_start, m_current);
-    m_tokens.emplace_back(
-        Token{type, std::move(text), std::make_unique<LiteralVal>(literal), m_line});
+    LOX_DEBUG("Adding a token with lexeme {} literal N/A start {} current {}", text, m_start,
+              m_current);
+    m_token.emplace(type, text, m_line);
 }
 
 void Scanner::addToken(TokenType type, double literal)
 {
     auto text = m_source.substr(m_start, m_current - m_start);
-    spdlog::debug("Adding a token with lexeme {} literal {} start {} current {}", text, literal,
-                  m_start, m_current);
-    m_tokens.emplace_back(
-        Token{type, std::move(text), std::make_unique<LiteralVal>(literal), m_line});
+    LOX_DEBUG("Adding a token with lexeme {} literal {} start {} current {}", text, literal,
+              m_start, m_current);
+    m_token.emplace(type, text, literal, m_line);
 }
 
 bool Scanner::match(char expected)
@@ -162,7 +286,7 @@ bool Scanner::match(char expected)
     {
         return false;
     }
-    if (m_source.at(m_current) != expected)
+    if (m_source[m_current] != expected)
     {
         return false;
     }
@@ -176,7 +300,7 @@ char Scanner::peek()
     {
         return '\0';
     }
-    return m_source.at(m_current);
+    return m_source[m_current];
 }
 
 char Scanner::peekNext()
@@ -185,86 +309,62 @@ char Scanner::peekNext()
     {
         return '\0';
     }
-    return m_source.at(m_current + 1);
+    return m_source[m_current + 1];
 }
 
 void Scanner::string()
 {
-    while (peek() != '"' && !isAtEnd())
-    {
-        if (peek() == '\n')
-        {
-            m_line++;
-        }
-        advance();
-    }
+    m_current = static_cast<int>(simd::findQuote(m_source, m_current, m_line));
 
     if (isAtEnd())
     {
         Application::error(m_line, "Unterminated string");
+        m_had_error = true;
         return;
     }
 
     // The closing ".
     advance();
 
-    // Trim those quotes
-    std::string value = m_source.substr(m_start + 1, m_current - m_start - 2);
-    addToken(TokenType::STRING, value);
+    // The token keeps the quotes, Token::string() trims them
+    addToken(TokenType::STRING);
 }
 
 void Scanner::number()
 {
-    while (std::isdigit(peek()) != 0)
+    while (isDigit(peek()))
     {
         advance();
     }
 
     // Look for a fractional part
-    if (peek() == '.' && std::isdigit(peekNext()) != 0)
+    if (peek() == '.' && isDigit(peekNext()))
     {
         // Consume the "."
         advance();
 
-        while (std::isdigit(peek()) != 0)
+        while (isDigit(peek()))
         {
             advance();
         }
     }
 
     auto numstr = m_source.substr(m_start, m_current - m_start);
-    auto val = std::stod(numstr);
-    addToken(TokenType::NUMBER, (double)val);
+    double val{0};
+    std::from_chars(numstr.data(), numstr.data() + numstr.size(), val);
+    addToken(TokenType::NUMBER, val);
 }
 
 void Scanner::identifier()
 {
-    while (std::isalnum(peek()) != 0)
+    while (isAlphaNumeric(peek()))
     {
         advance();
     }
 
     auto text = m_source.substr(m_start, m_current - m_start);
 
-    TokenType type;
-    try
-    {
-        type = Keywords.at(text);
-    }
-    catch (std::out_of_range& e)
-    {
-        type = TokenType::IDENTIFIER;
-    }
-
-    addToken(type, text);
+    addToken(keywordType(text));
 }
 
-const std::map<std::string, TokenType> Scanner::Keywords = {
-    {"and", TokenType::AND},     {"class", TokenType::CLASS},   {"else", TokenType::ELSE},
-    {"false", TokenType::FALSE}, {"for", TokenType::FOR},       {"fun", TokenType::FUN},
-    {"if", TokenType::IF},       {"nil", TokenType::NIL},       {"or", TokenType::OR},
-    {"print", TokenType::PRINT}, {"return", TokenType::RETURN}, {"super", TokenType::SUPER},
-    {"this", TokenType::THIS},   {"true", TokenType::TRUE},     {"var", TokenType::VAR},
-    {"while", TokenType::WHILE}};
-
 }  // namespace lox
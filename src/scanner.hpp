@@ -1,6 +1,8 @@
 #pragma once
-#include <map>
+#include <cstddef>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "token.hpp"
@@ -11,20 +13,31 @@ class Token;
 class Scanner
 {
 public:
-    explicit Scanner(const std::string &source);
+    // Tokens refer into source, which must outlive them
+    explicit Scanner(std::string_view source);
 
-    std::vector<Token> &scanTokens();
+    // Scans up to and including the next token, END_OF_FILE once the source is exhausted
+    Token nextToken();
+
+    // Scans everything left in the source, ending with END_OF_FILE
+    std::vector<Token> scanTokens();
+
+    // Scans the rest of the source now, nextToken() then hands out the buffered tokens. Lets
+    // --stats time scanning apart from the parsing that pulls the tokens.
+    void scanAhead();
+
+    // True once an error has been reported for the source
+    [[nodiscard]] bool hadError() const { return m_had_error; }
 
     // Delete undesired constructors (Allow move, not copy or assign)
     Scanner(const Scanner &) = delete;
     Scanner &operator=(const Scanner &) = delete;
 
 private:
+    Token scanNext();
     bool isAtEnd();
     void scanToken();
     char advance();
-    void addToken(TokenType type, std::string &literal);
-    void addToken(TokenType type, bool literal);
     void addToken(TokenType type, double literal);
     void addToken(TokenType type);
     bool match(char expected);
@@ -35,13 +48,16 @@ private:
     void number();
     void identifier();
 
-    const std::string &m_source{};
-    std::vector<Token> m_tokens{};
+    const std::string_view m_source{};
+    // Set by addToken, taken by nextToken
+    std::optional<Token> m_token{};
+    // Filled by scanAhead
+    std::vector<Token> m_ahead{};
+    std::size_t m_next_ahead{0};
     int m_start{0};
     int m_current{0};
     int m_line{1};
-
-    static const std::map<std::string, TokenType> Keywords;
+    bool m_had_error{false};
 };
 
 }  // namespace lox
@@ -0,0 +1,235 @@
+#include "simd_scan.hpp"
+
+#include <cstdint>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && defined(__GNUC__)
+#define LOX_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define LOX_SIMD_X86 0
+#endif
+
+namespace lox::simd
+{
+namespace
+{
+constexpr bool isWhitespace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+std::size_t skipWhitespaceScalar(std::string_view text, std::size_t pos, int& lines)
+{
+    for (; pos < text.size() && isWhitespace(text[pos]); pos++)
+    {
+        lines += static_cast<int>(text[pos] == '\n');
+    }
+    return pos;
+}
+
+std::size_t findNewlineScalar(std::string_view text, std::size_t pos)
+{
+    auto found = text.find('\n', pos);
+    return found == std::string_view::npos ? text.size() : found;
+}
+
+std::size_t findQuoteScalar(std::string_view text, std::size_t pos, int& lines)
+{
+    for (; pos < text.size() && text[pos] != '"'; pos++)
+    {
+        lines += static_cast<int>(text[pos] == '\n');
+    }
+    return pos;
+}
+
+#if LOX_SIMD_X86
+// The kernels below compare a whole block against the characters of interest and turn the
+// result into a bitmask with one bit per byte, so the position of the first hit is the count of
+// trailing zeros and the newlines before it are a popcount. Any tail shorter than a block is left
+// to the scalar loops, nothing is read past the end of the text.
+
+int countBefore(std::uint32_t newlines, unsigned index)
+{
+    return __builtin_popcount(newlines & ((std::uint32_t{1} << index) - 1));
+}
+
+std::size_t skipWhitespaceSse2(std::string_view text, std::size_t pos, int& lines)
+{
+    const auto space = _mm_set1_epi8(' ');
+    const auto tab = _mm_set1_epi8('\t');
+    const auto carriage = _mm_set1_epi8('\r');
+    const auto newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= text.size(); pos += 16)
+    {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+        auto is_newline = _mm_cmpeq_epi8(block, newline);
+        auto is_space = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(block, space), _mm_cmpeq_epi8(block, tab)),
+            _mm_or_si128(_mm_cmpeq_epi8(block, carriage), is_newline));
+        auto other = ~static_cast<std::uint32_t>(_mm_movemask_epi8(is_space)) & 0xFFFFU;
+        auto newlines = static_cast<std::uint32_t>(_mm_movemask_epi8(is_newline));
+        if (other != 0)
+        {
+            auto index = static_cast<unsigned>(__builtin_ctz(other));
+            lines += countBefore(newlines, index);
+            return pos + index;
+        }
+        lines += __builtin_popcount(newlines);
+    }
+    return skipWhitespaceScalar(text, pos, lines);
+}
+
+std::size_t findNewlineSse2(std::string_view text, std::size_t pos)
+{
+    const auto newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= text.size(); pos += 16)
+    {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+        auto found =
+            static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        if (found != 0)
+        {
+            return pos + static_cast<unsigned>(__builtin_ctz(found));
+        }
+    }
+    return findNewlineScalar(text, pos);
+}
+
+std::size_t findQuoteSse2(std::string_view text, std::size_t pos, int& lines)
+{
+    const auto quote = _mm_set1_epi8('"');
+    const auto newline = _mm_set1_epi8('\n');
+    for (; pos + 16 <= text.size(); pos += 16)
+    {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+        auto found =
+            static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, quote)));
+        auto newlines =
+            static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, newline)));
+        if (found != 0)
+        {
+            auto index = static_cast<unsigned>(__builtin_ctz(found));
+            lines += countBefore(newlines, index);
+            return pos + index;
+        }
+        lines += __builtin_popcount(newlines);
+    }
+    return findQuoteScalar(text, pos, lines);
+}
+
+__attribute__((target("avx2"))) std::size_t skipWhitespaceAvx2(std::string_view text,
+                                                               std::size_t pos, int& lines)
+{
+    const auto space = _mm256_set1_epi8(' ');
+    const auto tab = _mm256_set1_epi8('\t');
+    const auto carriage = _mm256_set1_epi8('\r');
+    const auto newline = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= text.size(); pos += 32)
+    {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+        auto is_newline = _mm256_cmpeq_epi8(block, newline);
+        auto is_space = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, space), _mm256_cmpeq_epi8(block, tab)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(block, carriage), is_newline));
+        auto other = ~static_cast<std::uint32_t>(_mm256_movemask_epi8(is_space));
+        auto newlines = static_cast<std::uint32_t>(_mm256_movemask_epi8(is_newline));
+        if (other != 0)
+        {
+            auto index = static_cast<unsigned>(__builtin_ctz(other));
+            lines += countBefore(newlines, index);
+            return pos + index;
+        }
+        lines += __builtin_popcount(newlines);
+    }
+    return skipWhitespaceSse2(text, pos, lines);
+}
+
+__attribute__((target("avx2"))) std::size_t findNewlineAvx2(std::string_view text,
+                                                            std::size_t pos)
+{
+    const auto newline = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= text.size(); pos += 32)
+    {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+        auto found =
+            static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+        if (found != 0)
+        {
+            return pos + static_cast<unsigned>(__builtin_ctz(found));
+        }
+    }
+    return findNewlineSse2(text, pos);
+}
+
+__attribute__((target("avx2"))) std::size_t findQuoteAvx2(std::string_view text, std::size_t pos,
+                                                          int& lines)
+{
+    const auto quote = _mm256_set1_epi8('"');
+    const auto newline = _mm256_set1_epi8('\n');
+    for (; pos + 32 <= text.size(); pos += 32)
+    {
+        auto block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+        auto found =
+            static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, quote)));
+        auto newlines =
+            static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(block, newline)));
+        if (found != 0)
+        {
+            auto index = static_cast<unsigned>(__builtin_ctz(found));
+            lines += countBefore(newlines, index);
+            return pos + index;
+        }
+        lines += __builtin_popcount(newlines);
+    }
+    return findQuoteSse2(text, pos, lines);
+}
+#endif
+
+struct Kernels
+{
+    std::size_t (*skip_whitespace)(std::string_view, std::size_t, int&);
+    std::size_t (*find_newline)(std::string_view, std::size_t);
+    std::size_t (*find_quote)(std::string_view, std::size_t, int&);
+    const char* name;
+};
+
+Kernels selectKernels()
+{
+#if LOX_SIMD_X86
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return {skipWhitespaceAvx2, findNewlineAvx2, findQuoteAvx2, "avx2"};
+    }
+    return {skipWhitespaceSse2, findNewlineSse2, findQuoteSse2, "sse2"};
+#else
+    return {skipWhitespaceScalar, findNewlineScalar, findQuoteScalar, "scalar"};
+#endif
+}
+
+const Kernels& kernels()
+{
+    static const Kernels Selected = selectKernels();
+    return Selected;
+}
+}  // namespace
+
+std::size_t skipWhitespace(std::string_view text, std::size_t pos, int& lines)
+{
+    // Most runs are a single space between tokens, not worth a vector load
+    if (pos + 1 < text.size() && isWhitespace(text[pos]) && !isWhitespace(text[pos + 1]))
+    {
+        lines += static_cast<int>(text[pos] == '\n');
+        return pos + 1;
+    }
+    return kernels().skip_whitespace(text, pos, lines);
+}
+
+std::size_t findNewline(std::string_view text, std::size_t pos)
+{
+    return kernels().find_newline(text, pos);
+}
+
+std::size_t findQuote(std::string_view text, std::size_t pos, int& lines)
+{
+    return kernels().find_quote(text, pos, lines);
+}
+
+const char* kernelName() { return kernels().name; }
+}  // namespace lox::simd
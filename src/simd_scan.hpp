@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+namespace lox::simd
+{
+// Bulk skipping helpers for the Scanner. Each one starts at pos and returns the offset of the
+// first character it did not skip, or text.size() when it ran off the end. The SSE2 or AVX2
+// kernel is picked once at startup depending on the running CPU, other targets use a scalar
+// loop.
+
+// Skips spaces, tabs, carriage returns and newlines, adding the newlines to lines
+std::size_t skipWhitespace(std::string_view text, std::size_t pos, int& lines);
+
+// Finds the next newline, used to skip comment bodies
+std::size_t findNewline(std::string_view text, std::size_t pos);
+
+// Finds the next double quote, adding the newlines before it to lines
+std::size_t findQuote(std::string_view text, std::size_t pos, int& lines);
+
+// Name of the kernel in use, for logging
+const char* kernelName();
+}  // namespace lox::simd
@@ -0,0 +1,116 @@
+#include "source_buffer.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "exception.hpp"
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOX_HAS_MMAP 1
+#else
+#include <fstream>
+#include <sstream>
+#define LOX_HAS_MMAP 0
+#endif
+
+namespace lox
+{
+std::shared_ptr<const SourceBuffer> SourceBuffer::fromString(std::string text)
+{
+    // Not make_shared, the constructor is private
+    std::shared_ptr<SourceBuffer> buffer(new SourceBuffer());
+    buffer->m_owned = std::move(text);
+    buffer->m_data = buffer->m_owned.data();
+    buffer->m_size = buffer->m_owned.size();
+    return buffer;
+}
+
+#if LOX_HAS_MMAP
+std::shared_ptr<const SourceBuffer> SourceBuffer::fromFile(const std::string& path)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw IoError("Cannot open " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat info
+    {
+    };
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0)
+    {
+        auto size = static_cast<std::size_t>(info.st_size);
+        void* memory = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory != MAP_FAILED)
+        {
+            ::close(fd);
+            ::madvise(memory, size, MADV_SEQUENTIAL);
+            std::shared_ptr<SourceBuffer> buffer(new SourceBuffer());
+            buffer->m_data = static_cast<const char*>(memory);
+            buffer->m_size = size;
+            buffer->m_mapped = true;
+            spdlog::debug("Mapped {} bytes of {}", size, path);
+            return buffer;
+        }
+        spdlog::debug("Could not map {}, reading it instead", path);
+    }
+
+    // Pipes and other unmappable files, grow the buffer as data arrives
+    std::string text;
+    if (S_ISREG(info.st_mode))
+    {
+        text.reserve(static_cast<std::size_t>(info.st_size));
+    }
+    char chunk[64 * 1024];
+    while (true)
+    {
+        auto count = ::read(fd, chunk, sizeof(chunk));
+        if (count < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (count < 0)
+        {
+            auto error = errno;
+            ::close(fd);
+            throw IoError("Cannot read " + path + ": " + std::strerror(error));
+        }
+        if (count == 0)
+        {
+            break;
+        }
+        text.append(chunk, static_cast<std::size_t>(count));
+    }
+    ::close(fd);
+    return fromString(std::move(text));
+}
+
+SourceBuffer::~SourceBuffer()
+{
+    if (m_mapped)
+    {
+        ::munmap(const_cast<char*>(m_data), m_size);
+    }
+}
+#else
+std::shared_ptr<const SourceBuffer> SourceBuffer::fromFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw IoError("Cannot open " + path);
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    return fromString(text.str());
+}
+
+SourceBuffer::~SourceBuffer() = default;
+#endif
+}  // namespace lox
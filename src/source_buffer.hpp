@@ -0,0 +1,36 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace lox
+{
+// Read only script text that tokens and AST nodes point into. Regular files are memory mapped,
+// anything that cannot be mapped (pipes, terminals, empty files) is read into an owned string.
+// Shared so a Program can keep the text alive for as long as its nodes refer to it.
+class SourceBuffer
+{
+public:
+    // Throws IoError if the file cannot be opened or read
+    static std::shared_ptr<const SourceBuffer> fromFile(const std::string& path);
+    static std::shared_ptr<const SourceBuffer> fromString(std::string text);
+
+    ~SourceBuffer();
+
+    // Delete undesired constructors (Not copy, move or assign)
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    [[nodiscard]] std::string_view view() const { return {m_data, m_size}; }
+    [[nodiscard]] bool mapped() const { return m_mapped; }
+
+private:
+    SourceBuffer() = default;
+
+    std::string m_owned;
+    const char* m_data{nullptr};
+    std::size_t m_size{0};
+    bool m_mapped{false};
+};
+}  // namespace lox
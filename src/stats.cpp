@@ -0,0 +1,147 @@
+#include "stats.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+namespace lox
+{
+namespace
+{
+using Clock = std::chrono::steady_clock;
+
+struct PhaseCounters
+{
+    Clock::duration time{};
+    std::uint64_t allocations{0};
+    std::uint64_t bytes{0};
+};
+
+// Constant initialized, operator new can run before main
+struct Counters
+{
+    std::array<PhaseCounters, Stats::Phase_Count> phases{};
+    std::array<std::uint64_t, Stats::Counter_Count> counters{};
+    Stats::Phase phase{Stats::Phase::Other};
+    Clock::time_point since{};
+};
+Counters counters;
+
+const std::array<const char*, Stats::Phase_Count> Phase_Names{"other", "scan", "parse",
+                                                              "analyze", "execute"};
+}  // namespace
+
+void Stats::enable()
+{
+    counters.since = Clock::now();
+    s_enabled = true;
+}
+
+Stats::Phase Stats::enter(Phase phase)
+{
+    auto now = Clock::now();
+    counters.phases[static_cast<std::size_t>(counters.phase)].time += now - counters.since;
+    counters.since = now;
+    return std::exchange(counters.phase, phase);
+}
+
+void Stats::add(Counter counter, std::uint64_t amount)
+{
+    counters.counters[static_cast<std::size_t>(counter)] += amount;
+}
+
+void Stats::allocation(std::size_t bytes)
+{
+    auto& phase = counters.phases[static_cast<std::size_t>(counters.phase)];
+    phase.allocations++;
+    phase.bytes += bytes;
+}
+
+void Stats::report()
+{
+    if (!s_enabled)
+    {
+        return;
+    }
+    // Closes the interval in progress
+    enter(counters.phase);
+    auto count = [](Counter counter) {
+        return counters.counters[static_cast<std::size_t>(counter)];
+    };
+
+    for (std::size_t phase = 0; phase < Phase_Count; phase++)
+    {
+        const auto& stats = counters.phases[phase];
+        auto milliseconds = std::chrono::duration<double, std::milli>(stats.time).count();
+        spdlog::info("Stats: {:<8} {:>10.3f} ms {:>10} allocations {:>12} bytes",
+                     Phase_Names[phase], milliseconds, stats.allocations, stats.bytes);
+    }
+    spdlog::info("Stats: {} tokens, {} AST nodes", count(Counter::Tokens), count(Counter::Nodes));
+    auto lookups = count(Counter::Lookups);
+    spdlog::info("Stats: {} environments created, {} variable lookups, {:.2f} average depth walked",
+                 count(Counter::Environments), lookups,
+                 lookups == 0 ? 0.0
+                              : static_cast<double>(count(Counter::Depth_Walked)) /
+                                    static_cast<double>(lookups));
+}
+}  // namespace lox
+
+namespace
+{
+// Retries through the new handler like the standard allocator
+template <typename Allocate>
+void* allocateOrThrow(Allocate allocate)
+{
+    while (true)
+    {
+        if (void* memory = allocate())
+        {
+            return memory;
+        }
+        auto* handler = std::get_new_handler();
+        if (handler == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+}  // namespace
+
+// Replaces the global allocator so --stats can count heap allocations. The array, nothrow and
+// other forms of the standard library end up in these.
+void* operator new(std::size_t size)
+{
+    lox::Stats::countAllocation(size);
+    if (size == 0)
+    {
+        size = 1;
+    }
+    return allocateOrThrow([size]() { return std::malloc(size); });
+}
+
+// Over-aligned types (alignas beyond that of max_align_t)
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    lox::Stats::countAllocation(size);
+    auto align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants a whole number of alignments
+    auto rounded = (std::max<std::size_t>(size, 1) + align - 1) / align * align;
+    return allocateOrThrow([rounded, align]() { return std::aligned_alloc(align, rounded); });
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+
+void operator delete(void* memory, std::size_t /*size*/) noexcept { std::free(memory); }
+
+void operator delete(void* memory, std::align_val_t /*alignment*/) noexcept { std::free(memory); }
+
+void operator delete(void* memory, std::size_t /*size*/, std::align_val_t /*alignment*/) noexcept
+{
+    std::free(memory);
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace lox
+{
+// Counters behind --stats. Nothing is recorded until enable() is called and every hook is an
+// inline test of one flag before that, so they stay compiled into release binaries.
+// Single threaded like the rest of the interpreter.
+class Stats
+{
+public:
+    // Time and heap allocations are charged to the innermost phase in progress
+    enum class Phase : std::uint8_t
+    {
+        Other,
+        Scan,
+        Parse,
+        Analyze,
+        Execute,
+    };
+    static constexpr std::size_t Phase_Count = 5;
+    // Number of values counted besides the phases
+    static constexpr std::size_t Counter_Count = 5;
+
+    // Charges everything up to the end of the scope to a phase, then returns to the enclosing one
+    class Scope
+    {
+    public:
+        explicit Scope(Phase phase) : m_active(enabled())
+        {
+            if (m_active)
+            {
+                m_previous = enter(phase);
+            }
+        }
+        ~Scope()
+        {
+            if (m_active)
+            {
+                enter(m_previous);
+            }
+        }
+
+        // Delete undesired constructors (Not copy, move or assign)
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        bool m_active;
+        Phase m_previous{Phase::Other};
+    };
+
+    static void enable();
+    [[nodiscard]] static bool enabled() { return s_enabled; }
+
+    static void countToken()
+    {
+        if (s_enabled)
+        {
+            add(Counter::Tokens, 1);
+        }
+    }
+    static void countNode()
+    {
+        if (s_enabled)
+        {
+            add(Counter::Nodes, 1);
+        }
+    }
+    static void countEnvironment()
+    {
+        if (s_enabled)
+        {
+            add(Counter::Environments, 1);
+        }
+    }
+    // A variable read or write that walked depth enclosing environments
+    static void countLookup(int depth)
+    {
+        if (s_enabled)
+        {
+            add(Counter::Lookups, 1);
+            add(Counter::Depth_Walked, depth);
+        }
+    }
+    // Called by the global operator new
+    static void countAllocation(std::size_t bytes)
+    {
+        if (s_enabled)
+        {
+            allocation(bytes);
+        }
+    }
+
+    // Logs everything counted since enable()
+    static void report();
+
+private:
+    enum class Counter : std::uint8_t
+    {
+        Tokens,
+        Nodes,
+        Environments,
+        Lookups,
+        Depth_Walked,
+    };
+
+    // Returns the phase that was in progress
+    static Phase enter(Phase phase);
+    static void add(Counter counter, std::uint64_t amount);
+    static void allocation(std::size_t bytes);
+
+    inline static bool s_enabled{false};
+};
+}  // namespace lox
@@ -2,10 +2,10 @@
 #include <spdlog/fmt/fmt.h>
 
 #include <string>
-#include <type_traits>
+#include <string_view>
+
+#include "number_format.hpp"
 
-#include "exception.hpp"
-#include "literal.hpp"
 namespace lox
 {
 enum class TokenType
@@ -59,41 +59,52 @@ enum class TokenType
     END_OF_FILE
 };
 
+// Tokens do not own their text, the lexeme is a view into the source buffer the Scanner read,
+// which must outlive every token and AST node built from them. Only number literals carry a
+// payload, the value of a string literal is its lexeme without the quotes.
 class Token
 {
 public:
-    Token(TokenType type, std::string lexeme, std::unique_ptr<LiteralVal> literal, int line)
-        : m_type(type), m_lexeme(std::move(lexeme)), m_line(line), m_literal(std::move(literal))
+    Token(TokenType type, std::string_view lexeme, int line)
+        : m_type(type), m_line(line), m_lexeme(lexeme)
     {
     }
-    Token(const Token& other)
-        : m_type(other.m_type),
-          m_lexeme(other.m_lexeme),
-          m_line(other.m_line),
-          m_literal(std::make_unique<LiteralVal>(*other.m_literal))
+    Token(TokenType type, std::string_view lexeme, double number, int line)
+        : m_type(type), m_line(line), m_lexeme(lexeme), m_number(number)
     {
     }
-    Token(Token&& other) noexcept = default;
     [[nodiscard]] TokenType type() const { return m_type; }
-    [[nodiscard]] std::string lexeme() const { return m_lexeme; }
+    [[nodiscard]] std::string_view lexeme() const { return m_lexeme; }
     [[nodiscard]] int line() const { return m_line; }
-    [[nodiscard]] const LiteralVal& literal() const { return *m_literal; };
+
+    // Value of a NUMBER token
+    [[nodiscard]] double number() const { return m_number; }
+    // Contents of a STRING token
+    [[nodiscard]] std::string_view string() const
+    {
+        return m_lexeme.size() < 2 ? std::string_view() : m_lexeme.substr(1, m_lexeme.size() - 2);
+    }
 
     [[nodiscard]] std::string repr() const
     {
-        if (m_literal)
+        if (m_type == TokenType::NUMBER)
+        {
+            return fmt::format("TokenType: {}, lexeme: {}, literal: {}", m_type, m_lexeme,
+                               formatNumber(m_number));
+        }
+        if (m_type == TokenType::STRING)
         {
             return fmt::format("TokenType: {}, lexeme: {}, literal: {}", m_type, m_lexeme,
-                               m_literal->repr());
+                               string());
         }
         return fmt::format("TokenType: {}, lexeme: {}, literal: N/A", m_type, m_lexeme);
     }
 
 private:
     TokenType m_type;
-    const std::string m_lexeme;
-    const int m_line;
-    std::unique_ptr<const LiteralVal> m_literal;
+    int m_line;
+    std::string_view m_lexeme;
+    double m_number{0};
 };
 
 }  // namespace lox
@@ -0,0 +1,53 @@
+#pragma once
+#include <spdlog/spdlog.h>
+
+// Logging for code that runs per token, node or value. LOX_TRACE and LOX_DEBUG take the same
+// arguments as spdlog::trace and spdlog::debug, but
+//  - levels below LOX_ACTIVE_LEVEL (one of the SPDLOG_LEVEL_ constants, set from the
+//    LOX_LOG_LEVEL CMake option) are removed at compile time, their arguments still have to
+//    compile but nothing is evaluated
+//  - the arguments of the levels that remain are only evaluated if the level is enabled
+// LOX_TRACE_EVENT logs a structured event at trace level as logfmt, "event=<name> key=value...",
+// with the format and arguments following the name. Events are only compiled in when
+// LOX_TRACE_EVENTS is defined, whatever the active level.
+
+#ifndef LOX_ACTIVE_LEVEL
+#define LOX_ACTIVE_LEVEL SPDLOG_LEVEL_INFO
+#endif
+
+#define LOX_LOG_LAZY(level, log, ...)          \
+    do                                         \
+    {                                          \
+        if (spdlog::should_log(level))         \
+        {                                      \
+            log(__VA_ARGS__);                  \
+        }                                      \
+    } while (false)
+
+#define LOX_LOG_STRIPPED(log, ...) \
+    do                             \
+    {                              \
+        if constexpr (false)       \
+        {                          \
+            log(__VA_ARGS__);      \
+        }                          \
+    } while (false)
+
+#if LOX_ACTIVE_LEVEL <= SPDLOG_LEVEL_TRACE
+#define LOX_TRACE(...) LOX_LOG_LAZY(spdlog::level::trace, spdlog::trace, __VA_ARGS__)
+#else
+#define LOX_TRACE(...) LOX_LOG_STRIPPED(spdlog::trace, __VA_ARGS__)
+#endif
+
+#if LOX_ACTIVE_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define LOX_DEBUG(...) LOX_LOG_LAZY(spdlog::level::debug, spdlog::debug, __VA_ARGS__)
+#else
+#define LOX_DEBUG(...) LOX_LOG_STRIPPED(spdlog::debug, __VA_ARGS__)
+#endif
+
+#ifdef LOX_TRACE_EVENTS
+#define LOX_TRACE_EVENT(name, ...) \
+    LOX_LOG_LAZY(spdlog::level::trace, spdlog::trace, "event=" name " " __VA_ARGS__)
+#else
+#define LOX_TRACE_EVENT(name, ...) LOX_LOG_STRIPPED(spdlog::trace, "event=" name " " __VA_ARGS__)
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+
+namespace lox
+{
+// What a binary expression has seen so far, recorded on the node by the Interpreter.
+// Nodes start Unseen, the first evaluation specializes them to the matching number-number
+// operation when both operands are numbers, and any later mismatch deoptimizes them to
+// Generic for good so a polymorphic site does not flip back and forth.
+enum class BinaryFeedback : std::uint8_t
+{
+    Unseen,
+    NumberAdd,
+    NumberSubtract,
+    NumberMultiply,
+    NumberDivide,
+    NumberGreater,
+    NumberGreaterEqual,
+    NumberLess,
+    NumberLessEqual,
+    Generic,
+};
+}  // namespace lox
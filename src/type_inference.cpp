@@ -0,0 +1,221 @@
+#include "type_inference.hpp"
+
+#include <algorithm>
+#include <utility>
+
+namespace lox
+{
+void TypeInference::infer(Program& program)
+{
+    // Globals from earlier programs start out Unknown
+    m_state.assign(1, Scope{});
+    for (auto& statement : program.statements())
+    {
+        infer(rawNode(statement));
+    }
+}
+
+TypeInference::Inferred TypeInference::infer(Expression* expression)
+{
+    if (expression == nullptr)
+    {
+        return {Type::Unknown, false};
+    }
+    expression->accept(*this);
+    return m_inferred;
+}
+
+void TypeInference::infer(Statement* statement)
+{
+    if (statement != nullptr)
+    {
+        statement->accept(*this);
+    }
+}
+
+TypeInference::Type& TypeInference::variable(int depth, int slot)
+{
+    auto& scope = m_state[m_state.size() - 1 - depth];
+    if (slot >= static_cast<int>(scope.size()))
+    {
+        scope.resize(slot + 1, Type::Unknown);
+    }
+    return scope[slot];
+}
+
+void TypeInference::join(const State& other)
+{
+    for (std::size_t level = 0; level < m_state.size(); level++)
+    {
+        auto& scope = m_state[level];
+        const auto& incoming = other[level];
+        scope.resize(std::max(scope.size(), incoming.size()), Type::Unknown);
+        for (std::size_t slot = 0; slot < scope.size(); slot++)
+        {
+            if (slot >= incoming.size() || incoming[slot] != Type::Number)
+            {
+                scope[slot] = Type::Unknown;
+            }
+        }
+    }
+}
+
+void TypeInference::visitStatementBlock(StatementBlock& statement)
+{
+    if (statement.getStatements() == nullptr)
+    {
+        return;
+    }
+    if (statement.getScoped())
+    {
+        m_state.emplace_back();
+    }
+    for (auto& inner : *statement.getStatements())
+    {
+        infer(rawNode(inner));
+    }
+    if (statement.getScoped())
+    {
+        m_state.pop_back();
+    }
+}
+
+void TypeInference::visitStatementExpression(StatementExpression& statement)
+{
+    infer(statement.getExpression());
+}
+
+void TypeInference::visitStatementIf(StatementIf& statement)
+{
+    infer(statement.getCondition());
+    auto otherwise = m_state;
+    infer(statement.getthenBranch());
+    std::swap(otherwise, m_state);
+    infer(statement.getelseBranch());
+    join(otherwise);
+}
+
+void TypeInference::visitStatementPrint(StatementPrint& statement)
+{
+    infer(statement.getExpression());
+}
+
+void TypeInference::visitStatementWhile(StatementWhile& statement)
+{
+    // Iterates until the state at the top of the loop stops changing. Types only ever go from
+    // Number to Unknown so this terminates, and the last round marks the nodes with the final
+    // state.
+    auto head = m_state;
+    while (true)
+    {
+        infer(statement.getCondition());
+        auto exit = m_state;
+        infer(statement.getBody());
+        join(head);
+        if (m_state == head)
+        {
+            m_state = std::move(exit);
+            return;
+        }
+        head = m_state;
+    }
+}
+
+void TypeInference::visitStatementVariable(StatementVariable& statement)
+{
+    // A declaration without initializer holds nil
+    auto type = statement.getInitializer() != nullptr ? infer(statement.getInitializer()).type
+                                                       : Type::Unknown;
+    variable(0, statement.getSlot()) = type;
+}
+
+void TypeInference::visitExpressionAssign(ExpressionAssign& expression)
+{
+    auto value = infer(expression.getValue());
+    if (expression.getDepth() < 0)
+    {
+        m_inferred = {Type::Unknown, false};
+        return;
+    }
+    variable(expression.getDepth(), expression.getSlot()) = value.type;
+    m_inferred = value;
+}
+
+void TypeInference::visitExpressionBinary(ExpressionBinary& expression)
+{
+    auto left = infer(expression.getLeft());
+    auto right = infer(expression.getRight());
+    bool unboxed = left.unboxed && right.unboxed;
+    expression.setUnboxed(unboxed);
+
+    switch (expression.getToken().type())
+    {
+    case TokenType::MINUS:
+    case TokenType::SLASH:
+    case TokenType::STAR:
+        // Anything else raises an error, so a number is all that can come out
+        m_inferred = {Type::Number, unboxed};
+        break;
+    case TokenType::PLUS:
+        // Two strings are concatenated
+        if (left.type == Type::Number && right.type == Type::Number)
+        {
+            m_inferred = {Type::Number, unboxed};
+        }
+        else
+        {
+            m_inferred = {Type::Unknown, false};
+        }
+        break;
+    default:
+        m_inferred = {Type::Unknown, false};
+        break;
+    }
+}
+
+void TypeInference::visitExpressionLogical(ExpressionLogical& expression)
+{
+    auto left = infer(expression.getLeft());
+    // The right side does not run when the left one decides
+    auto skipped = m_state;
+    auto right = infer(expression.getRight());
+    join(skipped);
+    bool numbers = left.type == Type::Number && right.type == Type::Number;
+    m_inferred = {numbers ? Type::Number : Type::Unknown, false};
+}
+
+void TypeInference::visitExpressionGrouping(ExpressionGrouping& expression)
+{
+    m_inferred = infer(expression.getExpression());
+}
+
+void TypeInference::visitExpressionLiteral(ExpressionLiteral& expression)
+{
+    bool number = expression.getValue().isNumber();
+    m_inferred = {number ? Type::Number : Type::Unknown, number};
+}
+
+void TypeInference::visitExpressionUnary(ExpressionUnary& expression)
+{
+    auto operand = infer(expression.getExpression());
+    if (expression.getToken().type() == TokenType::MINUS)
+    {
+        expression.setUnboxed(operand.unboxed);
+        m_inferred = {Type::Number, operand.unboxed};
+        return;
+    }
+    expression.setUnboxed(false);
+    m_inferred = {Type::Unknown, false};
+}
+
+void TypeInference::visitExpressionVariable(ExpressionVariable& expression)
+{
+    if (expression.getDepth() < 0)
+    {
+        m_inferred = {Type::Unknown, false};
+        return;
+    }
+    auto type = variable(expression.getDepth(), expression.getSlot());
+    m_inferred = {type, type == Type::Number};
+}
+}  // namespace lox
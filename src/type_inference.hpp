@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "expression_ast.hpp"
+#include "program.hpp"
+#include "statement_ast.hpp"
+
+namespace lox
+{
+// Static pass run after the Resolver. It follows the control flow of the program, tracking
+// which variables are known to hold a number at each point, and marks the binary and unary
+// expressions whose operands are proven numbers as Unboxed. The Interpreter evaluates those on
+// raw doubles with the NumberEvaluator, which cannot fail, so errors are raised exactly where
+// they were before.
+class TypeInference : public ExpressionVisitorVoid, public StatementVisitorVoid
+{
+public:
+    void infer(Program& program);
+
+private:
+    // Unknown also covers variables declared by earlier programs, nothing is assumed about them
+    enum class Type : std::uint8_t
+    {
+        Unknown,
+        Number,
+    };
+    // Variable types indexed by slot, missing slots are Unknown
+    using Scope = std::vector<Type>;
+    using State = std::vector<Scope>;
+
+    struct Inferred
+    {
+        Type type;
+        // The NumberEvaluator can compute the value, which implies type is Number
+        bool unboxed;
+    };
+
+    Inferred infer(Expression* expression);
+    void infer(Statement* statement);
+
+    Type& variable(int depth, int slot);
+    // Merges the state of another control flow path into the current one
+    void join(const State& other);
+
+    void visitStatementBlock(StatementBlock& statement) override;
+    void visitStatementExpression(StatementExpression& statement) override;
+    void visitStatementIf(StatementIf& statement) override;
+    void visitStatementPrint(StatementPrint& statement) override;
+    void visitStatementWhile(StatementWhile& statement) override;
+    void visitStatementVariable(StatementVariable& statement) override;
+
+    void visitExpressionAssign(ExpressionAssign& expression) override;
+    void visitExpressionBinary(ExpressionBinary& expression) override;
+    void visitExpressionLogical(ExpressionLogical& expression) override;
+    void visitExpressionGrouping(ExpressionGrouping& expression) override;
+    void visitExpressionLiteral(ExpressionLiteral& expression) override;
+    void visitExpressionUnary(ExpressionUnary& expression) override;
+    void visitExpressionVariable(ExpressionVariable& expression) override;
+
+    // Innermost scope at the back, mirroring the scopes of the Resolver
+    State m_state;
+    // Result of the expression visit in progress
+    Inferred m_inferred{Type::Unknown, false};
+};
+}  // namespace lox
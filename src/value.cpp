@@ -0,0 +1,211 @@
+#include "value.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <unordered_map>
+#include <vector>
+
+#include "number_format.hpp"
+
+namespace lox
+{
+namespace
+{
+// Interned strings by contents, the keys view the objects' own characters. Never destroyed so
+// Values that outlive main's locals can still unregister.
+std::unordered_map<std::string_view, StringObject *> &internTable()
+{
+    static auto *table = new std::unordered_map<std::string_view, StringObject *>();
+    return *table;
+}
+}  // namespace
+
+StringObject::StringObject(std::string chars) : m_length(chars.size()), m_chars(std::move(chars))
+{
+}
+
+StringObject::StringObject(StringObject *left, StringObject *right)
+    : m_length(left->m_length + right->m_length), m_left(left), m_right(right)
+{
+    m_left->m_refcount++;
+    m_right->m_refcount++;
+}
+
+StringObject::~StringObject()
+{
+    if (m_interned)
+    {
+        internTable().erase(m_chars);
+    }
+}
+
+StringObject *StringObject::create(std::string chars)
+{
+    if (chars.size() <= Intern_Max_Length)
+    {
+        return intern(chars);
+    }
+    return new StringObject(std::move(chars));
+}
+
+StringObject *StringObject::intern(std::string_view chars)
+{
+    auto &table = internTable();
+    auto found = table.find(chars);
+    if (found != table.end())
+    {
+        return found->second;
+    }
+    auto *string = new StringObject(std::string(chars));
+    string->m_interned = true;
+    table.emplace(string->m_chars, string);
+    return string;
+}
+
+StringObject *StringObject::concatenate(StringObject *left, StringObject *right)
+{
+    if (left->m_length == 0)
+    {
+        return right;
+    }
+    if (right->m_length == 0)
+    {
+        return left;
+    }
+    if (left->m_length + right->m_length < Rope_Min_Length)
+    {
+        return create(left->chars() + right->chars());
+    }
+    return new StringObject(left, right);
+}
+
+void StringObject::flatten() const
+{
+    std::string chars;
+    chars.reserve(m_length);
+    // Depth first, left to right. Nodes flattened earlier are used as they are.
+    std::vector<const StringObject *> pending{m_right, m_left};
+    while (!pending.empty())
+    {
+        const auto *string = pending.back();
+        pending.pop_back();
+        if (string->m_left != nullptr)
+        {
+            pending.push_back(string->m_right);
+            pending.push_back(string->m_left);
+        }
+        else
+        {
+            chars += string->m_chars;
+        }
+    }
+    m_chars = std::move(chars);
+    release(std::exchange(m_left, nullptr));
+    release(std::exchange(m_right, nullptr));
+}
+
+void StringObject::release(StringObject *string)
+{
+    if (--string->m_refcount > 0)
+    {
+        return;
+    }
+    std::vector<StringObject *> unused{string};
+    while (!unused.empty())
+    {
+        auto *current = unused.back();
+        unused.pop_back();
+        for (auto *child : {current->m_left, current->m_right})
+        {
+            if (child != nullptr && --child->m_refcount == 0)
+            {
+                unused.push_back(child);
+            }
+        }
+        delete current;
+    }
+}
+
+Value::Value(std::string string) : Value(StringObject::create(std::move(string))) {}
+
+Value Value::intern(std::string_view string) { return Value(StringObject::intern(string)); }
+
+Value Value::concatenate(const Value &left, const Value &right)
+{
+    return Value(StringObject::concatenate(left.m_as.string, right.m_as.string));
+}
+
+Value::Value(const LiteralVal &literal)
+{
+    switch (literal.type())
+    {
+    case LiteralValType::String:
+        m_type = ValueType::String;
+        m_as.string = StringObject::intern(getLiteral<std::string>(literal));
+        retain();
+        break;
+    case LiteralValType::Bool:
+        m_type = ValueType::Bool;
+        m_as.boolean = getLiteral<bool>(literal);
+        break;
+    case LiteralValType::Number:
+        m_type = ValueType::Number;
+        m_as.number = getLiteral<double>(literal);
+        break;
+    case LiteralValType::Nil:
+        m_type = ValueType::Nil;
+        m_as.number = 0;
+        break;
+    }
+}
+
+bool Value::operator==(const Value &other) const
+{
+    if (m_type != other.m_type)
+    {
+        return false;
+    }
+    switch (m_type)
+    {
+    case ValueType::Nil:
+        return true;
+    case ValueType::Bool:
+        return m_as.boolean == other.m_as.boolean;
+    case ValueType::Number:
+        return m_as.number == other.m_as.number;
+    case ValueType::String:
+    {
+        const auto *left = m_as.string;
+        const auto *right = other.m_as.string;
+        if (left == right)
+        {
+            return true;
+        }
+        // There is only one interned object per contents
+        if ((left->interned() && right->interned()) || left->length() != right->length())
+        {
+            return false;
+        }
+        return left->chars() == right->chars();
+    }
+    }
+    return false;
+}
+
+std::string Value::repr() const
+{
+    switch (m_type)
+    {
+    case ValueType::Nil:
+        return "nil";
+    case ValueType::Bool:
+        return m_as.boolean ? "true" : "false";
+    case ValueType::Number:
+        return formatNumber(m_as.number);
+    case ValueType::String:
+        return asString();
+    }
+    spdlog::error("Value repr() requested but type is invalid {}", static_cast<int>(m_type));
+    throw(std::exception());
+}
+}  // namespace lox
@@ -0,0 +1,170 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "literal.hpp"
+
+namespace lox
+{
+enum class ValueType : std::uint8_t
+{
+    Nil,
+    Bool,
+    Number,
+    String
+};
+
+// Immutable, reference counted string shared between every Value that holds it.
+// The interpreter is single threaded so the count is a plain integer.
+// Literals and short strings are interned, so two interned strings are equal only if they are
+// the same object. Long concatenations are rope nodes pointing at both halves, their
+// characters are gathered the first time they are read.
+class StringObject
+{
+public:
+    // Runtime strings up to this length are interned
+    static constexpr std::size_t Intern_Max_Length = 32;
+    // Shorter concatenations are copied right away instead of making a rope node
+    static constexpr std::size_t Rope_Min_Length = 256;
+
+    // The returned objects may be shared already, callers take a reference through Value
+    static StringObject *create(std::string chars);
+    static StringObject *intern(std::string_view chars);
+    static StringObject *concatenate(StringObject *left, StringObject *right);
+
+    // Delete undesired constructors, string objects are only shared through Value
+    StringObject(const StringObject &) = delete;
+    StringObject &operator=(const StringObject &) = delete;
+    ~StringObject();
+
+    [[nodiscard]] const std::string &chars() const
+    {
+        if (m_left != nullptr)
+        {
+            flatten();
+        }
+        return m_chars;
+    }
+    [[nodiscard]] std::size_t length() const { return m_length; }
+    [[nodiscard]] bool interned() const { return m_interned; }
+
+private:
+    friend class Value;
+    explicit StringObject(std::string chars);
+    StringObject(StringObject *left, StringObject *right);
+
+    // Copies the characters of the rope below this node and lets go of it
+    void flatten() const;
+    // Drops a reference, freeing the objects nobody holds anymore. A rope built by appending
+    // in a loop is as deep as it is long, so this does not recurse.
+    static void release(StringObject *string);
+
+    int m_refcount{0};
+    bool m_interned{false};
+    std::size_t m_length;
+    mutable std::string m_chars;
+    // Both set while this is an unflattened rope node
+    mutable StringObject *m_left{nullptr};
+    mutable StringObject *m_right{nullptr};
+};
+
+// Runtime value produced by the interpreter. Numbers, booleans and nil are stored inline,
+// so copying one never touches the allocator; strings are a pointer to a shared StringObject.
+class Value
+{
+public:
+    Value() : m_type(ValueType::Nil) { m_as.number = 0; }
+    explicit Value(double number) : m_type(ValueType::Number) { m_as.number = number; }
+    explicit Value(bool boolean) : m_type(ValueType::Bool) { m_as.boolean = boolean; }
+    explicit Value(std::string string);
+    explicit Value(const LiteralVal &literal);
+    // Strings from the source text, always interned
+    static Value intern(std::string_view string);
+    // Both values have to be strings
+    static Value concatenate(const Value &left, const Value &right);
+
+    Value(const Value &other) : m_type(other.m_type), m_as(other.m_as) { retain(); }
+    Value(Value &&other) noexcept : m_type(other.m_type), m_as(other.m_as)
+    {
+        other.m_type = ValueType::Nil;
+    }
+    Value &operator=(const Value &other)
+    {
+        if (this != &other)
+        {
+            Value copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+    Value &operator=(Value &&other) noexcept
+    {
+        Value moved(std::move(other));
+        swap(moved);
+        return *this;
+    }
+    ~Value() { release(); }
+
+    [[nodiscard]] ValueType type() const { return m_type; }
+    [[nodiscard]] bool isNil() const { return m_type == ValueType::Nil; }
+    [[nodiscard]] bool isBool() const { return m_type == ValueType::Bool; }
+    [[nodiscard]] bool isNumber() const { return m_type == ValueType::Number; }
+    [[nodiscard]] bool isString() const { return m_type == ValueType::String; }
+    // nil and false are falsey, everything else is truthy
+    [[nodiscard]] bool isTruthy() const
+    {
+        return !(m_type == ValueType::Nil || (m_type == ValueType::Bool && !m_as.boolean));
+    }
+
+    // Callers are expected to check the type first
+    [[nodiscard]] double asNumber() const { return m_as.number; }
+    [[nodiscard]] bool asBool() const { return m_as.boolean; }
+    [[nodiscard]] const std::string &asString() const { return m_as.string->chars(); }
+
+    bool operator==(const Value &other) const;
+    bool operator!=(const Value &other) const { return !(*this == other); }
+
+    [[nodiscard]] std::string repr() const;
+
+private:
+    explicit Value(StringObject *string) : m_type(ValueType::String)
+    {
+        m_as.string = string;
+        retain();
+    }
+
+    void swap(Value &other) noexcept
+    {
+        std::swap(m_type, other.m_type);
+        std::swap(m_as, other.m_as);
+    }
+    void retain()
+    {
+        if (m_type == ValueType::String)
+        {
+            m_as.string->m_refcount++;
+        }
+    }
+    void release()
+    {
+        if (m_type == ValueType::String)
+        {
+            StringObject::release(m_as.string);
+        }
+    }
+
+    ValueType m_type;
+    union
+    {
+        double number;
+        bool boolean;
+        StringObject *string;
+    } m_as;
+};
+
+static_assert(sizeof(Value) == 16, "Value should stay two words wide");
+
+}  // namespace lox
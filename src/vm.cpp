@@ -0,0 +1,423 @@
+#include "vm.hpp"
+
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+
+#include "interpreter.hpp"
+
+// Threaded dispatch through a table of label addresses is a GNU extension, everything else
+// falls back to a plain switch
+#if defined(__GNUC__) || defined(__clang__)
+#define LOX_VM_COMPUTED_GOTO 1
+#else
+#define LOX_VM_COMPUTED_GOTO 0
+#endif
+
+namespace lox
+{
+namespace
+{
+// Rebuilds the operator token for error reporting so messages match the Interpreter
+Token operatorToken(OpCode op, int line)
+{
+    auto token = [line](TokenType type, const char* lexeme) {
+        return Token{type, lexeme, line};
+    };
+    switch (op)
+    {
+    case OpCode::Greater:
+        return token(TokenType::GREATER, ">");
+    case OpCode::GreaterEqual:
+        return token(TokenType::GREATER_EQUAL, ">=");
+    case OpCode::Less:
+        return token(TokenType::LESS, "<");
+    case OpCode::LessEqual:
+        return token(TokenType::LESS_EQUAL, "<=");
+    case OpCode::Add:
+        return token(TokenType::PLUS, "+");
+    case OpCode::Subtract:
+    case OpCode::Negate:
+        return token(TokenType::MINUS, "-");
+    case OpCode::Multiply:
+        return token(TokenType::STAR, "*");
+    case OpCode::Divide:
+        return token(TokenType::SLASH, "/");
+    default:
+        return token(TokenType::END_OF_FILE, "");
+    }
+}
+}  // namespace
+
+bool Vm::interpret(Program& program)
+{
+    // Error tokens may view names in the constant pool, so the chunk outlives the handlers
+    Chunk chunk;
+    try
+    {
+        chunk = m_compiler.compile(program);
+        run(chunk);
+    }
+    catch (CompileError& error)
+    {
+        m_output.flush();
+        spdlog::error("[line {}] Compile error: {}", error.line(), error.what());
+        return false;
+    }
+    catch (RuntimeError& error)
+    {
+        m_output.flush();
+        spdlog::error(error.what());
+        spdlog::error("Error found on line {} token {}", error.token().line(),
+                      error.token().lexeme());
+        return false;
+    }
+    return true;
+}
+
+#if LOX_VM_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+void Vm::run(const Chunk& chunk)
+{
+    if (static_cast<int>(m_stack.size()) < chunk.maxStack())
+    {
+        m_stack.resize(chunk.maxStack());
+    }
+    if (static_cast<int>(m_globals.size()) < chunk.globalCount())
+    {
+        m_globals.resize(chunk.globalCount());
+    }
+
+    const auto* code = chunk.code().data();
+    const auto* ip = code;
+    const auto* constants = chunk.constants().data();
+    auto* stack = m_stack.data();
+    auto* sp = stack;
+    auto* globals = m_globals.data();
+
+    // Drops the values still on the stack so shared strings are released
+    auto unwind = [stack, &sp]() {
+        while (sp != stack)
+        {
+            *--sp = Value();
+        }
+    };
+    auto error = [&chunk, code, &ip, &unwind](OpCode op, const std::string& message) {
+        auto line = chunk.getLine(ip - code - 1);
+        unwind();
+        return RuntimeError(operatorToken(op, line), message);
+    };
+
+#define READ_SHORT() (ip += 2, static_cast<std::uint16_t>(ip[-2] | (ip[-1] << 8)))
+#define READ_LONG() (ip += 3, static_cast<std::uint32_t>(ip[-3] | (ip[-2] << 8) | (ip[-1] << 16)))
+#define POP() (*--sp = Value())
+#define BINARY_NUMBER(op, oper)                                   \
+    if (!sp[-2].isNumber() || !sp[-1].isNumber())                 \
+    {                                                             \
+        throw error(OpCode::op, "Operands must be a number.");    \
+    }                                                             \
+    sp[-2] = Value(sp[-2].asNumber() oper sp[-1].asNumber());     \
+    POP()
+
+#if LOX_VM_COMPUTED_GOTO
+    // Must be kept in the same order as OpCode
+    static void* dispatch_table[] = {
+        &&op_Constant,
+        &&op_Nil,
+        &&op_True,
+        &&op_False,
+        &&op_Pop,
+        &&op_PopN,
+        &&op_GetGlobal,
+        &&op_DefineGlobal,
+        &&op_SetGlobal,
+        &&op_GetLocal,
+        &&op_SetLocal,
+        &&op_Undefined,
+        &&op_Equal,
+        &&op_NotEqual,
+        &&op_Greater,
+        &&op_GreaterEqual,
+        &&op_Less,
+        &&op_LessEqual,
+        &&op_Add,
+        &&op_Subtract,
+        &&op_Multiply,
+        &&op_Divide,
+        &&op_Not,
+        &&op_Negate,
+        &&op_Print,
+        &&op_Jump,
+        &&op_JumpIfFalse,
+        &&op_Loop,
+        &&op_Return,
+        &&op_ConstantLong,
+        &&op_GetGlobalLong,
+        &&op_DefineGlobalLong,
+        &&op_SetGlobalLong,
+        &&op_UndefinedLong,
+        &&op_JumpLong,
+        &&op_JumpIfFalseLong,
+        &&op_LoopLong,
+    };
+#define DISPATCH() goto* dispatch_table[*ip++]
+#define TARGET(op) op_##op:
+    DISPATCH();
+#else
+#define DISPATCH() continue
+#define TARGET(op) case OpCode::op:
+    for (;;)
+    {
+        switch (static_cast<OpCode>(*ip++))
+        {
+#endif
+
+    TARGET(Constant)
+    {
+        *sp++ = constants[READ_SHORT()];
+        DISPATCH();
+    }
+    TARGET(ConstantLong)
+    {
+        *sp++ = constants[READ_LONG()];
+        DISPATCH();
+    }
+    TARGET(Nil)
+    {
+        *sp++ = Value();
+        DISPATCH();
+    }
+    TARGET(True)
+    {
+        *sp++ = Value(true);
+        DISPATCH();
+    }
+    TARGET(False)
+    {
+        *sp++ = Value(false);
+        DISPATCH();
+    }
+    TARGET(Pop)
+    {
+        POP();
+        DISPATCH();
+    }
+    TARGET(PopN)
+    {
+        auto count = READ_SHORT();
+        for (int i = 0; i < count; i++)
+        {
+            POP();
+        }
+        DISPATCH();
+    }
+    TARGET(GetGlobal)
+    {
+        *sp++ = globals[READ_SHORT()];
+        DISPATCH();
+    }
+    TARGET(GetGlobalLong)
+    {
+        *sp++ = globals[READ_LONG()];
+        DISPATCH();
+    }
+    TARGET(DefineGlobal)
+    {
+        int slot = static_cast<int>(READ_SHORT());
+        globals[slot] = std::move(*--sp);
+        m_defined_globals = std::max(m_defined_globals, slot + 1);
+        DISPATCH();
+    }
+    TARGET(DefineGlobalLong)
+    {
+        int slot = static_cast<int>(READ_LONG());
+        globals[slot] = std::move(*--sp);
+        m_defined_globals = std::max(m_defined_globals, slot + 1);
+        DISPATCH();
+    }
+    TARGET(SetGlobal)
+    {
+        globals[READ_SHORT()] = sp[-1];
+        DISPATCH();
+    }
+    TARGET(SetGlobalLong)
+    {
+        globals[READ_LONG()] = sp[-1];
+        DISPATCH();
+    }
+    TARGET(GetLocal)
+    {
+        *sp++ = stack[READ_SHORT()];
+        DISPATCH();
+    }
+    TARGET(SetLocal)
+    {
+        stack[READ_SHORT()] = sp[-1];
+        DISPATCH();
+    }
+    TARGET(Undefined)
+    {
+        const auto& name = constants[READ_SHORT()].asString();
+        auto line = chunk.getLine(ip - code - 3);
+        unwind();
+        throw RuntimeError(Token{TokenType::IDENTIFIER, name, line},
+                           "Undefined variable " + name + ".");
+    }
+    TARGET(UndefinedLong)
+    {
+        const auto& name = constants[READ_LONG()].asString();
+        auto line = chunk.getLine(ip - code - 4);
+        unwind();
+        throw RuntimeError(Token{TokenType::IDENTIFIER, name, line},
+                           "Undefined variable " + name + ".");
+    }
+    TARGET(Equal)
+    {
+        sp[-2] = Value(sp[-2] == sp[-1]);
+        POP();
+        DISPATCH();
+    }
+    TARGET(NotEqual)
+    {
+        sp[-2] = Value(sp[-2] != sp[-1]);
+        POP();
+        DISPATCH();
+    }
+    TARGET(Greater)
+    {
+        BINARY_NUMBER(Greater, >);
+        DISPATCH();
+    }
+    TARGET(GreaterEqual)
+    {
+        BINARY_NUMBER(GreaterEqual, >=);
+        DISPATCH();
+    }
+    TARGET(Less)
+    {
+        BINARY_NUMBER(Less, <);
+        DISPATCH();
+    }
+    TARGET(LessEqual)
+    {
+        BINARY_NUMBER(LessEqual, <=);
+        DISPATCH();
+    }
+    TARGET(Add)
+    {
+        if (sp[-2].isNumber() && sp[-1].isNumber())
+        {
+            sp[-2] = Value(sp[-2].asNumber() + sp[-1].asNumber());
+        }
+        else if (sp[-2].isString() && sp[-1].isString())
+        {
+            sp[-2] = Value::concatenate(sp[-2], sp[-1]);
+        }
+        else
+        {
+            throw error(OpCode::Add, "Operands must be two numbers or two strings.");
+        }
+        POP();
+        DISPATCH();
+    }
+    TARGET(Subtract)
+    {
+        BINARY_NUMBER(Subtract, -);
+        DISPATCH();
+    }
+    TARGET(Multiply)
+    {
+        BINARY_NUMBER(Multiply, *);
+        DISPATCH();
+    }
+    TARGET(Divide)
+    {
+        BINARY_NUMBER(Divide, /);
+        DISPATCH();
+    }
+    TARGET(Not)
+    {
+        sp[-1] = Value(!sp[-1].isTruthy());
+        DISPATCH();
+    }
+    TARGET(Negate)
+    {
+        if (!sp[-1].isNumber())
+        {
+            throw error(OpCode::Negate, "Operand must be a number.");
+        }
+        sp[-1] = Value(-sp[-1].asNumber());
+        DISPATCH();
+    }
+    TARGET(Print)
+    {
+        m_output.line(sp[-1].repr());
+        POP();
+        DISPATCH();
+    }
+    TARGET(Jump)
+    {
+        auto offset = READ_SHORT();
+        ip += offset;
+        DISPATCH();
+    }
+    TARGET(JumpIfFalse)
+    {
+        auto offset = READ_SHORT();
+        if (!sp[-1].isTruthy())
+        {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    TARGET(JumpLong)
+    {
+        auto offset = READ_LONG();
+        ip += offset;
+        DISPATCH();
+    }
+    TARGET(JumpIfFalseLong)
+    {
+        auto offset = READ_LONG();
+        if (!sp[-1].isTruthy())
+        {
+            ip += offset;
+        }
+        DISPATCH();
+    }
+    TARGET(Loop)
+    {
+        auto offset = READ_SHORT();
+        ip -= offset;
+        DISPATCH();
+    }
+    TARGET(LoopLong)
+    {
+        auto offset = READ_LONG();
+        ip -= offset;
+        DISPATCH();
+    }
+    TARGET(Return)
+    {
+        unwind();
+        return;
+    }
+
+#if !LOX_VM_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef READ_SHORT
+#undef READ_LONG
+#undef POP
+#undef BINARY_NUMBER
+#undef DISPATCH
+#undef TARGET
+}
+#if LOX_VM_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+}  // namespace lox
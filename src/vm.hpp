@@ -0,0 +1,31 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include "chunk.hpp"
+#include "compiler.hpp"
+#include "engine.hpp"
+
+namespace lox
+{
+// Stack based virtual machine, the bytecode alternative to the tree walking Interpreter
+class Vm : public Engine
+{
+public:
+    explicit Vm(Output& output = Output::standard()) : Engine(output) {}
+
+    bool interpret(Program& program) override;
+    [[nodiscard]] int definedGlobals() const override { return m_defined_globals; }
+
+    // Throws RuntimeError, the value stack is left empty either way
+    void run(const Chunk& chunk);
+
+private:
+    Compiler m_compiler;
+    std::vector<Value> m_stack;
+    // Indexed by the slots the Resolver assigns, kept between runs for the prompt
+    std::vector<Value> m_globals;
+    // m_globals is sized for every declared global up front, this counts the defined ones
+    int m_defined_globals{0};
+};
+}  // namespace lox
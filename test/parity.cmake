@@ -0,0 +1,62 @@
+# Runs SCRIPT through the interpreter and fails if the printed values, the errors or the exit code
+# differ from the EXPECTED file. The same script then runs through every engine flag in ENGINES,
+# with --stream and twice with --cache (storing, then loading the parsed program from CACHE_DIR),
+# all of which have to match the interpreter.
+# Usage: cmake -DLOX=<main> -DSCRIPT=<file.lox> -DEXPECTED=<file.expected>
+#              -DENGINES=--vm,--closures -DCACHE_DIR=<dir> -P parity.cmake
+# Add -DUPDATE=ON to write the output of the interpreter to EXPECTED instead.
+
+function(run_lox flag out_var)
+    execute_process(
+        COMMAND ${LOX} ${flag} ${SCRIPT}
+        OUTPUT_VARIABLE output
+        ERROR_VARIABLE errors
+        RESULT_VARIABLE result
+        TIMEOUT 60
+    )
+    # Drop the timestamps of the spdlog lines, which go to stdout
+    string(REGEX REPLACE "\\[[0-9-]+ [0-9:.]+\\] " "" output "${output}")
+    string(REGEX REPLACE "\\[[0-9-]+ [0-9:.]+\\] " "" errors "${errors}")
+    set(${out_var} "exit ${result}\n--- stdout\n${output}--- stderr\n${errors}" PARENT_SCOPE)
+endfunction()
+
+function(check_same mode actual)
+    if(NOT actual STREQUAL expected)
+        message(
+            FATAL_ERROR
+            "${SCRIPT} differs with ${mode}\n=== interpreter\n${expected}\n=== ${mode}\n${actual}"
+        )
+    endif()
+endfunction()
+
+run_lox("" expected)
+if(UPDATE)
+    file(WRITE ${EXPECTED} "${expected}")
+    return()
+endif()
+if(NOT EXISTS ${EXPECTED})
+    message(FATAL_ERROR "${SCRIPT} has no expected output, write it with -DUPDATE=ON")
+endif()
+file(READ ${EXPECTED} golden)
+if(NOT expected STREQUAL golden)
+    message(
+        FATAL_ERROR
+        "${SCRIPT} differs from ${EXPECTED}\n=== expected\n${golden}\n=== interpreter\n${expected}"
+    )
+endif()
+
+string(REPLACE "," ";" ENGINES "${ENGINES}")
+foreach(engine ${ENGINES})
+    run_lox(${engine} actual)
+    check_same(${engine} "${actual}")
+endforeach()
+
+run_lox(--stream actual)
+check_same(--stream "${actual}")
+
+file(REMOVE_RECURSE ${CACHE_DIR})
+set(ENV{LOX_CACHE_DIR} ${CACHE_DIR})
+run_lox(--cache actual)
+check_same("--cache (storing)" "${actual}")
+run_lox(--cache actual)
+check_same("--cache (loading)" "${actual}")
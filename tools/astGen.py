@@ -71,13 +71,16 @@ class ValType(enum.Enum):
     REFERENCE = 2
     AST_NODE = 3
     STATEMENT_VEC = 3
+    # Filled in by later passes (e.g. the resolver), not by the constructor
+    ANNOTATION = 4
 
 
 class MemberVariable:
-    def __init__(self, name, type, val_type):
+    def __init__(self, name, type, val_type, default=None):
         self.name = name
         self.type = type
         self.val_type = val_type
+        self.default = default
 
     @property
     def membername(self):
@@ -91,6 +94,10 @@ class MemberVariable:
     def gettername(self):
         return f"get{self.name}".format()
 
+    @property
+    def settername(self):
+        return f"set{self.name}".format()
+
 
 class AstVisitor:
     def __init__(self, base, name, ret):
@@ -104,10 +111,18 @@ class AstVisitor:
 
 
 class AstBase:
-    def __init__(self, classname):
+    def __init__(self, classname, arena=False):
         self.classname = classname
         self.inherited = []
         self.visitors = []
+        # In arena mode nodes are bump allocated by a Program and refer to
+        # their children with plain pointers instead of owning them
+        self.arena = arena
+
+    def nodeptr(self, type):
+        if self.arena:
+            return f"{type}*"
+        return f"std::unique_ptr<{type}>"
 
     def addInherited(self, name, members, copyable=True):
         self.inherited.append(AstInherited(self, name, members, copyable))
@@ -131,12 +146,46 @@ class AstInherited:
     def visitmethodname(self):
         return f"visit{self.classname}".format()
 
+    @property
+    def constructed(self):
+        return [m for m in self.members if m.val_type != ValType.ANNOTATION]
+
+    @property
+    def annotations(self):
+        return [m for m in self.members if m.val_type == ValType.ANNOTATION]
+
 
 def declare_inherited_prototypes(w, base):
+    w.write(f"class {base.classname};".format())
     for inh in base.inherited:
         w.write(f"class {inh.classname};".format())
 
 
+def declare_aliases(w, base, aliases=[]):
+    w.write("// Owning handle used to build the tree, a plain pointer in arena mode")
+    w.write(f"using {base.classname}Ptr = {base.nodeptr(base.classname)};")
+    for (name, type) in aliases:
+        w.write(f"using {name} = {type};")
+
+
+def declare_helpers(w, arena):
+    w.write(f"constexpr bool Ast_Arena = {'true' if arena else 'false'};")
+    w.write()
+    w.write("// Plain pointer to a node however the tree refers to it")
+    w.write("template <typename T>")
+    w.write("T* rawNode(const std::unique_ptr<T>& node) {")
+    w.increase()
+    w.write("return node.get();")
+    w.decrease()
+    w.write("}")
+    w.write("template <typename T>")
+    w.write("T* rawNode(T* node) {")
+    w.increase()
+    w.write("return node;")
+    w.decrease()
+    w.write("}")
+
+
 def declare_visitors(w, base):
     for v in base.visitors:
         w.write(f"class {v.classname}".format() + "{")
@@ -153,26 +202,28 @@ def declare_visitors(w, base):
 def declare_inherited(w, base):
     def define_constructor():
         args = ""
-        for m in inh.members:
+        for m in inh.constructed:
             if m.val_type == ValType.VALUE:
                 args = args + f"{m.type} {m.localname}"
             elif m.val_type == ValType.REFERENCE:
                 args = args + f"{m.type} &{m.localname}"
+            elif m.val_type == ValType.AST_NODE and base.arena:
+                args = args + f"{m.type}* {m.localname}"
             elif m.val_type == ValType.AST_NODE:
                 args = args + f"std::unique_ptr<{m.type}> &&{m.localname}"
             elif m.val_type == ValType.STATEMENT_VEC:
                 args = args + f"{m.type} &&{m.localname}"
-            if not m is inh.members[-1]:
+            if not m is inh.constructed[-1]:
                 args = args + ', '
         # Don't use these constructors for implicit conversions
-        if (len(inh.members) == 1):
+        if (len(inh.constructed) == 1):
             qualifiers = "explicit "
         else:
             qualifiers = ""
         w.write(f"{qualifiers}{inh.classname}({args}):".format())
         w.increase()
-        for m in inh.members:
-            if not m is inh.members[-1]:
+        for m in inh.constructed:
+            if not m is inh.constructed[-1]:
                 lineend = ','
             else:
                 lineend = '{}'
@@ -184,7 +235,7 @@ def declare_inherited(w, base):
                 w.decrease()
 
     def define_copy_constructor():
-        if not inh.copyable:
+        if not inh.copyable or base.arena:
             w.write(f"{inh.classname}(const {inh.classname}& other) = delete;".format())
             return
         w.write(f"{inh.classname}(const {inh.classname}& other)".format() +
@@ -199,7 +250,8 @@ def declare_inherited(w, base):
             else:
                 lineend = '{}'
 
-            if m.val_type == ValType.VALUE or m.val_type == ValType.REFERENCE:
+            if (m.val_type == ValType.VALUE or m.val_type == ValType.REFERENCE
+                    or m.val_type == ValType.ANNOTATION):
                 w.write(f"{m.membername}(other.{m.membername})".format() +
                         lineend)
             elif m.val_type == ValType.AST_NODE:
@@ -209,6 +261,9 @@ def declare_inherited(w, base):
         w.decrease()
 
     def define_clone():
+        # Arena nodes are never copied
+        if base.arena:
+            return
         w.write("// Method for allowing polymorphic copy")
         w.write(
             f"std::unique_ptr<{base.classname}> clone() const override".format() +
@@ -222,7 +277,7 @@ def declare_inherited(w, base):
             return
         args = ""
         w.increase()
-        for m in inh.members:
+        for m in inh.constructed:
             if m.val_type == ValType.REFERENCE or m.val_type == ValType.VALUE:
                 args = args + f"{m.membername}"
             if m.val_type == ValType.AST_NODE:
@@ -233,9 +288,15 @@ def declare_inherited(w, base):
                 w.decrease()
                 w.write("}")
                 args = args + f"std::move(new{m.membername})"
-            if not m is inh.members[-1]:
+            if not m is inh.constructed[-1]:
                 args = args + ', '
-        w.write(f"return std::make_unique<{inh.classname}>({args});")
+        if inh.annotations:
+            w.write(f"auto result = std::make_unique<{inh.classname}>({args});")
+            for m in inh.annotations:
+                w.write(f"result->{m.membername} = {m.membername};")
+            w.write("return result;")
+        else:
+            w.write(f"return std::make_unique<{inh.classname}>({args});")
         w.decrease()
         w.write("}")
 
@@ -257,16 +318,40 @@ def declare_inherited(w, base):
                 rtype = f"{m.type}&".format()
                 rexpr = m.membername
             elif (m.val_type == ValType.VALUE):
-                rtype = m.type
+                rtype = f"const {m.type}&".format()
                 rexpr = m.membername
             elif (m.val_type == ValType.AST_NODE):
                 rtype = f"{m.type}*".format()
-                rexpr = f"{m.membername}.get()".format()
+                rexpr = f"rawNode({m.membername})".format()
+            elif (m.val_type == ValType.ANNOTATION):
+                # Annotations are not always scalars, a loop plan holds a vector.
+                # East const so pointer types stay well formed.
+                rtype = f"{m.type} const&"
+                rexpr = m.membername
             w.write(f"{rtype} {m.gettername}()".format() + "{")
             w.increase()
             w.write(f"return {rexpr};".format())
             w.decrease()
             w.write("}")
+            if (m.val_type == ValType.ANNOTATION):
+                w.write(f"void {m.settername}({m.type} {m.localname})".format() + "{")
+                w.increase()
+                w.write(f"{m.membername} = std::move({m.localname});".format())
+                w.decrease()
+                w.write("}")
+            if (m.val_type == ValType.AST_NODE):
+                # Let passes detach and replace children when rewriting the tree
+                nodeptr = base.nodeptr(m.type)
+                w.write(f"{nodeptr} take{m.name}()" + "{")
+                w.increase()
+                w.write(f"return std::move({m.membername});")
+                w.decrease()
+                w.write("}")
+                w.write(f"void {m.settername}({nodeptr} {m.localname})" + "{")
+                w.increase()
+                w.write(f"{m.membername} = std::move({m.localname});")
+                w.decrease()
+                w.write("}")
 
     def define_member_vars():
         for mem in inh.members:
@@ -274,14 +359,27 @@ def declare_inherited(w, base):
                     or mem.val_type == ValType.VALUE):
                 w.write(f"{mem.type} {mem.membername};".format())
             elif (mem.val_type == ValType.AST_NODE):
-                w.write(
-                    f"std::unique_ptr<{mem.type}> {mem.membername};".format())
+                w.write(f"{base.nodeptr(mem.type)} {mem.membername}{{}};")
+            elif (mem.val_type == ValType.ANNOTATION):
+                w.write(f"{mem.type} {mem.membername}{{{mem.default}}};")
+
+    def define_destructible_trait():
+        # Lets the arena skip registering a destructor for nodes whose
+        # members need no cleanup, child pointers never do in arena mode
+        types = [f"std::is_trivially_destructible_v<{m.type}>" for m in inh.members
+                 if m.val_type != ValType.AST_NODE]
+        trait = " && ".join(types) if types else "true"
+        w.write("// Checked by Arena before registering a destructor")
+        w.write(f"static constexpr bool Trivially_Destructible_Members = {trait};")
 
     for inh in base.inherited:
         w.write(f"class {inh.classname} : public {base.classname}".format() +
                 "{")
         w.write("public:")
         w.increase()
+        if base.arena:
+            define_destructible_trait()
+            w.write()
         w.write("// Constructors")
         define_constructor()
         define_copy_constructor()
@@ -316,8 +414,9 @@ def declare_baseclass(w, base):
     w.write(f"{base.classname}(const {base.classname}&) = delete;".format())
     w.write(f"virtual ~{base.classname}() = default;".format())
     w.write()
-    w.write(f"virtual std::unique_ptr<{base.classname}> clone() const= 0;".format())
-    w.write()
+    if not base.arena:
+        w.write(f"virtual std::unique_ptr<{base.classname}> clone() const= 0;".format())
+        w.write()
     for v in base.visitors:
         w.write(f"virtual {v.ret} accept({v.classname}&) = 0;".format())
     w.decrease()
@@ -340,31 +439,47 @@ def file_footer(w, namespace):
 def main():
     parser = argparse.ArgumentParser()
     parser.add_argument('output_directory')
+    parser.add_argument('--arena',
+                        action='store_true',
+                        help='Generate nodes for bump allocation from a Program arena')
     args = parser.parse_args()
     print("Output directory is {}".format(args.output_directory))
 
     expression_includes = [
-        '"literal.hpp"', '"token.hpp"', '<memory>', '<utility>'
+        '"literal.hpp"', '"token.hpp"', '"type_feedback.hpp"', '"value.hpp"',
+        '<memory>', '<type_traits>', '<utility>'
     ]
 
     # Set up the actual data we'll be using
-    expression_base = AstBase('Expression')
-    expression_base.addVisitor("LiteralVal", "std::unique_ptr<LiteralVal>")
+    expression_base = AstBase('Expression', args.arena)
+    expression_base.addVisitor("Value", "Value")
     expression_base.addVisitor("String", "std::string")
+    expression_base.addVisitor("Void", "void")
+    expression_base.addVisitor("Number", "double")
     expression_base.addInherited('Assign', [
         MemberVariable('Name', 'Token', ValType.VALUE),
-        MemberVariable('Value', 'Expression', ValType.AST_NODE)
+        MemberVariable('Value', 'Expression', ValType.AST_NODE),
+        MemberVariable('Depth', 'int', ValType.ANNOTATION, '-1'),
+        MemberVariable('Slot', 'int', ValType.ANNOTATION, '0')
     ])
     expression_base.addInherited('Binary', [
         MemberVariable('Left', 'Expression', ValType.AST_NODE),
         MemberVariable('Token', 'Token', ValType.VALUE),
-        MemberVariable('Right', 'Expression', ValType.AST_NODE)
+        MemberVariable('Right', 'Expression', ValType.AST_NODE),
+        MemberVariable('Feedback', 'BinaryFeedback', ValType.ANNOTATION,
+                       'BinaryFeedback::Unseen'),
+        # Set by TypeInference when both operands are proven numbers
+        MemberVariable('Unboxed', 'bool', ValType.ANNOTATION, 'false'),
+        # Set by the LoopOptimizer for loop invariants, whose value the Interpreter computes
+        # once when entering the loop
+        MemberVariable('Hoisted', 'bool', ValType.ANNOTATION, 'false'),
+        MemberVariable('HoistedValue', 'double', ValType.ANNOTATION, '0')
     ])
     expression_base.addInherited(
         'Grouping',
         [MemberVariable('Expression', 'Expression', ValType.AST_NODE)])
     expression_base.addInherited(
-        'Literal', [MemberVariable('Value', 'LiteralVal', ValType.VALUE)])
+        'Literal', [MemberVariable('Value', 'Value', ValType.VALUE)])
     expression_base.addInherited('Logical', [
         MemberVariable('Left', 'Expression', ValType.AST_NODE),
         MemberVariable('Token', 'Token', ValType.VALUE),
@@ -372,16 +487,24 @@ def main():
     ])
     expression_base.addInherited('Unary', [
         MemberVariable('Token', 'Token', ValType.VALUE),
-        MemberVariable('Expression', 'Expression', ValType.AST_NODE)
+        MemberVariable('Expression', 'Expression', ValType.AST_NODE),
+        MemberVariable('Unboxed', 'bool', ValType.ANNOTATION, 'false')
+    ])
+    expression_base.addInherited('Variable', [
+        MemberVariable('Name', 'Token', ValType.VALUE),
+        MemberVariable('Depth', 'int', ValType.ANNOTATION, '-1'),
+        MemberVariable('Slot', 'int', ValType.ANNOTATION, '0')
     ])
-    expression_base.addInherited(
-        'Variable', [MemberVariable('Name', 'Token', ValType.VALUE)])
 
     with FileWriter(os.path.join(args.output_directory,
                                  "expression_ast.hpp")) as w:
         file_header(w, expression_includes, "lox")
         declare_inherited_prototypes(w, expression_base)
         w.write()
+        declare_helpers(w, args.arena)
+        w.write()
+        declare_aliases(w, expression_base)
+        w.write()
         declare_visitors(w, expression_base)
         w.write()
         declare_baseclass(w, expression_base)
@@ -391,37 +514,50 @@ def main():
         file_footer(w, "lox")
 
     statement_includes = [
-        '"literal.hpp"', '"token.hpp"', '<memory>', '<utility>',
+        '"jit.hpp"', '"literal.hpp"', '"loop_plan.hpp"', '"token.hpp"',
+        '<memory>', '<type_traits>', '<utility>', '<vector>',
         '"expression_ast.hpp"'
     ]
 
     # Set up the actual data we'll be using
-    statement_base = AstBase('Statement')
+    statement_base = AstBase('Statement', args.arena)
     statement_base.addVisitor("Void", "void")
     statement_base.addVisitor("String", "std::string")
     statement_base.addInherited('Block', [
-        MemberVariable('Statements', 'std::vector<std::unique_ptr<Statement>>',
-                       ValType.STATEMENT_VEC)
+        MemberVariable('Statements', 'StatementList', ValType.STATEMENT_VEC),
+        # Cleared by the resolver for blocks that declare nothing
+        MemberVariable('Scoped', 'bool', ValType.ANNOTATION, 'true')
     ],
                                 copyable=False)
-    statement_base.addInherited(
-        'Expression',
-        [MemberVariable('Expression', 'Expression', ValType.AST_NODE)])
+    # Line is the source line of the statement. The parser knows it for statements that end in a
+    # semicolon, the Profiler derives it for the others.
+    statement_base.addInherited('Expression', [
+        MemberVariable('Line', 'int', ValType.VALUE),
+        MemberVariable('Expression', 'Expression', ValType.AST_NODE)
+    ])
     statement_base.addInherited('If', [
         MemberVariable('Condition', 'Expression', ValType.AST_NODE),
         MemberVariable('thenBranch', 'Statement', ValType.AST_NODE),
         MemberVariable('elseBranch', 'Statement', ValType.AST_NODE),
+        MemberVariable('Line', 'int', ValType.ANNOTATION, '0')
+    ])
+    statement_base.addInherited('Print', [
+        MemberVariable('Line', 'int', ValType.VALUE),
+        MemberVariable('Expression', 'Expression', ValType.AST_NODE)
     ])
-    statement_base.addInherited(
-        'Print',
-        [MemberVariable('Expression', 'Expression', ValType.AST_NODE)])
     statement_base.addInherited('Variable', [
         MemberVariable('Name', 'Token', ValType.VALUE),
         MemberVariable('Initializer', 'Expression', ValType.AST_NODE),
+        MemberVariable('Slot', 'int', ValType.ANNOTATION, '0'),
     ])
     statement_base.addInherited('While', [
         MemberVariable('Condition', 'Expression', ValType.AST_NODE),
-        MemberVariable('Body', 'Statement', ValType.AST_NODE)
+        MemberVariable('Body', 'Statement', ValType.AST_NODE),
+        # Iterations run by the Interpreter, -1 once the Jit rejected the loop
+        MemberVariable('Hotness', 'int', ValType.ANNOTATION, '0'),
+        MemberVariable('Native', 'NativeLoop*', ValType.ANNOTATION, 'nullptr'),
+        MemberVariable('Plan', 'LoopPlan', ValType.ANNOTATION, ''),
+        MemberVariable('Line', 'int', ValType.ANNOTATION, '0')
     ])
 
     with FileWriter(os.path.join(args.output_directory,
@@ -429,6 +565,11 @@ def main():
         file_header(w, statement_includes, "lox")
         declare_inherited_prototypes(w, statement_base)
         w.write()
+        declare_aliases(w, statement_base,
+                        [('StatementList', 'std::vector<StatementPtr>'),
+                         ('StatementListPtr',
+                          statement_base.nodeptr('StatementList'))])
+        w.write()
         declare_visitors(w, statement_base)
         w.write()
         declare_baseclass(w, statement_base)
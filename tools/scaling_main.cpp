@@ -0,0 +1,198 @@
+#include <spdlog/fmt/fmt.h>
+#include <spdlog/spdlog.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "interpreter.hpp"
+#include "loop_optimizer.hpp"
+#include "output.hpp"
+#include "parser.hpp"
+#include "pass_manager.hpp"
+#include "resolver.hpp"
+#include "scanner.hpp"
+#include "source_buffer.hpp"
+#include "type_inference.hpp"
+#include "workload.hpp"
+
+// Generates programs of growing size along one dimension and reports the time and the peak
+// memory of every phase of the pipeline, e.g.
+//   lox_scaling --dimension nesting --from 4 --steps 8 --statements 50
+// Each size runs in a forked process so peaks do not carry over and a crash (a stack overflow
+// in the recursive parser, say) only ends its own row.
+namespace
+{
+const std::array<const char*, 5> Phases{"generate", "scan", "parse", "analyze", "execute"};
+
+// Sent by the child over a pipe as each phase ends
+struct PhaseReport
+{
+    int phase;
+    std::size_t source_bytes;
+    double milliseconds;
+    // Highest resident set size of the process so far
+    long peak_kib;
+};
+
+long peakKib()
+{
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void runPhases(const lox::WorkloadOptions& options, int fd)
+{
+    std::size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    auto report = [&](int phase) {
+        auto now = std::chrono::steady_clock::now();
+        PhaseReport result{phase, bytes,
+                           std::chrono::duration<double, std::milli>(now - start).count(),
+                           peakKib()};
+        (void)!write(fd, &result, sizeof(result));
+        start = std::chrono::steady_clock::now();
+    };
+
+    auto source = lox::SourceBuffer::fromString(lox::WorkloadGenerator(options).generate());
+    bytes = source->view().size();
+    report(0);
+
+    lox::Scanner(source->view()).scanTokens();
+    report(1);
+
+    // Tokens are pulled by the parser, so this also includes scanning
+    lox::Scanner scanner(source->view());
+    lox::Parser parser(scanner);
+    auto program = parser.parse();
+    program.retain(source);
+    report(2);
+
+    lox::PassManager::defaultPipeline().run(program);
+    lox::Resolver().resolve(program);
+    lox::TypeInference().infer(program);
+    lox::LoopOptimizer().optimize(program);
+    report(3);
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> null(std::fopen("/dev/null", "w"),
+                                                         &std::fclose);
+    lox::Output output(null.get());
+    lox::Interpreter(output).interpret(program);
+    output.flush();
+    report(4);
+}
+
+// Returns false if the child could not be started
+bool measure(const std::string& dimension, int value, const lox::WorkloadOptions& options)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+    std::fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        return false;
+    }
+    if (pid == 0)
+    {
+        close(fds[0]);
+        runPhases(options, fds[1]);
+        _exit(0);
+    }
+
+    close(fds[1]);
+    PhaseReport result{};
+    int completed = 0;
+    while (read(fds[0], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result)))
+    {
+        fmt::print("{:<17} {:>8} {:>12} {:<9} {:>12.3f} {:>10}\n", dimension, value,
+                   result.source_bytes, Phases.at(result.phase), result.milliseconds,
+                   result.peak_kib);
+        completed++;
+    }
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    if (WIFSIGNALED(status))
+    {
+        fmt::print("{:<17} {:>8} {:>12} {:<9} killed by signal {}\n", dimension, value, "",
+                   Phases.at(completed), WTERMSIG(status));
+    }
+    return true;
+}
+}  // namespace
+
+int main(int argc, char* argv[])
+{
+    lox::WorkloadOptions options;
+    std::string dimension = "statements";
+    int from = 0;
+    int steps = 6;
+    int factor = 2;
+    bool valid = true;
+    for (int i = 1; valid && i < argc; i += 2)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0 || i + 1 == argc)
+        {
+            valid = false;
+        }
+        else if (arg == "--dimension")
+        {
+            dimension = argv[i + 1];
+        }
+        else if (arg == "--from" || arg == "--steps" || arg == "--factor")
+        {
+            auto number = std::atoi(argv[i + 1]);
+            (arg == "--from" ? from : arg == "--steps" ? steps : factor) = number;
+            valid = number > 0;
+        }
+        else
+        {
+            valid = options.set(arg.substr(2), argv[i + 1]);
+        }
+    }
+    // Without --from the sweep starts at the value the options give the dimension
+    if (valid && from == 0)
+    {
+        from = std::max(options.get(dimension), 1);
+    }
+    valid = valid && options.get(dimension) >= 0;
+    if (!valid)
+    {
+        spdlog::warn(
+            "Usage: {} [--dimension statements|nesting|variables|expression-depth|string-length] "
+            "[--from N] [--steps N] [--factor N] [--seed N] [--statements N] [--nesting N] "
+            "[--variables N] [--expression-depth N] [--string-length N]",
+            argv[0]);
+        return 1;
+    }
+
+    fmt::print("{:<17} {:>8} {:>12} {:<9} {:>12} {:>10}\n", "dimension", "value", "source bytes",
+               "phase", "time ms", "peak KiB");
+    int value = from;
+    for (int step = 0; step < steps; step++, value *= factor)
+    {
+        auto sized = options;
+        sized.set(dimension, std::to_string(value));
+        if (!measure(dimension, value, sized))
+        {
+            spdlog::error("Cannot start a process to measure {} {}", dimension, value);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,201 @@
+#include "workload.hpp"
+
+#include <spdlog/fmt/fmt.h>
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace lox
+{
+namespace
+{
+constexpr int Max_Indent = 8;
+
+// The size option called name, const or not as options is
+template <typename Options>
+auto field(Options& options, const std::string& name) -> decltype(&options.statements)
+{
+    if (name == "statements")
+    {
+        return &options.statements;
+    }
+    if (name == "nesting")
+    {
+        return &options.nesting;
+    }
+    if (name == "variables")
+    {
+        return &options.variables;
+    }
+    if (name == "expression-depth")
+    {
+        return &options.expression_depth;
+    }
+    if (name == "string-length")
+    {
+        return &options.string_length;
+    }
+    return nullptr;
+}
+}  // namespace
+
+bool WorkloadOptions::set(const std::string& name, const std::string& value)
+{
+    long number = 0;
+    try
+    {
+        number = std::stol(value);
+    }
+    catch (std::logic_error&)
+    {
+        return false;
+    }
+    if (number < 0 || number > std::numeric_limits<int>::max())
+    {
+        return false;
+    }
+    if (name == "seed")
+    {
+        seed = static_cast<std::uint32_t>(number);
+        return true;
+    }
+
+    // Simple statements always assign a variable
+    int minimum = name == "variables" ? 1 : 0;
+    auto* size = field(*this, name);
+    if (size == nullptr || number < minimum)
+    {
+        return false;
+    }
+    *size = static_cast<int>(number);
+    return true;
+}
+
+int WorkloadOptions::get(const std::string& name) const
+{
+    const auto* size = field(*this, name);
+    return size != nullptr ? *size : -1;
+}
+
+std::string WorkloadGenerator::generate()
+{
+    m_out.clear();
+    declarations(0, 0);
+    for (int i = 0; i < m_options.statements; i++)
+    {
+        block(1, 0);
+    }
+    return std::move(m_out);
+}
+
+void WorkloadGenerator::line(int indent, const std::string& text)
+{
+    // Capped so the size of deeply nested programs grows linearly with their depth
+    m_out.append(static_cast<std::size_t>(std::min(indent, Max_Indent)) * 4, ' ');
+    m_out += text;
+    m_out += '\n';
+}
+
+void WorkloadGenerator::declarations(int level, int indent)
+{
+    for (int i = 0; i < m_options.variables; i++)
+    {
+        // Only variables of enclosing levels exist while the initializer runs
+        auto initializer = level == 0 ? std::to_string(next(100)) : expression(level - 1, 1);
+        line(indent, fmt::format("var v{}x{} = {};", level, i, initializer));
+    }
+    line(indent, fmt::format("var s{} = \"\";", level));
+}
+
+void WorkloadGenerator::block(int level, int indent)
+{
+    if (level > m_options.nesting)
+    {
+        simpleStatement(level - 1, indent);
+        return;
+    }
+    line(indent, "{");
+    declarations(level, indent + 1);
+    block(level + 1, indent + 1);
+    line(indent, "}");
+}
+
+void WorkloadGenerator::simpleStatement(int level, int indent)
+{
+    switch (next(5))
+    {
+    case 0:
+        line(indent, fmt::format("{} = {};", variable(level),
+                                 expression(level, m_options.expression_depth)));
+        break;
+    case 1:
+        line(indent, fmt::format("print {};", expression(level, m_options.expression_depth)));
+        break;
+    case 2:
+        line(indent, fmt::format("if ({} < {}) {{", expression(level, m_options.expression_depth),
+                                 leaf(level)));
+        line(indent + 1, fmt::format("{} = {};", variable(level), leaf(level)));
+        line(indent, "} else {");
+        line(indent + 1, fmt::format("{} = {};", variable(level), leaf(level)));
+        line(indent, "}");
+        break;
+    case 3:
+        line(indent, "for (var k = 0; k < 4; k = k + 1) {");
+        line(indent + 1, fmt::format("{} = {};", variable(level),
+                                     expression(level, m_options.expression_depth)));
+        line(indent, "}");
+        break;
+    default:
+    {
+        auto name = fmt::format("s{}", next(level + 1));
+        line(indent, fmt::format("{} = {} + \"{}\";", name, name, text()));
+        break;
+    }
+    }
+}
+
+std::string WorkloadGenerator::expression(int level, int depth)
+{
+    if (depth == 0)
+    {
+        return leaf(level);
+    }
+    // Only numbers are involved, so no operator can fail
+    static const char* const Operators[] = {"+", "-", "*"};
+    const char* op = Operators[next(3)];
+    switch (next(3))
+    {
+    case 0:
+        return fmt::format("({} {} {})", expression(level, depth - 1), op, leaf(level));
+    case 1:
+        return fmt::format("({} {} {})", leaf(level), op, expression(level, depth - 1));
+    default:
+        return fmt::format("-{}", expression(level, depth - 1));
+    }
+}
+
+std::string WorkloadGenerator::leaf(int level)
+{
+    if (next(3) == 0)
+    {
+        return std::to_string(next(10));
+    }
+    return variable(level);
+}
+
+std::string WorkloadGenerator::variable(int level)
+{
+    return fmt::format("v{}x{}", next(level + 1), next(m_options.variables));
+}
+
+std::string WorkloadGenerator::text()
+{
+    std::string chars;
+    for (int i = 0; i < m_options.string_length; i++)
+    {
+        chars += static_cast<char>('a' + next(26));
+    }
+    return chars;
+}
+}  // namespace lox
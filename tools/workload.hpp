@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace lox
+{
+// Shape of a generated program. Every top level statement is a chain of `nesting` blocks, each
+// declaring `variables` numbers and one string, around a simple statement that uses variables
+// of all the enclosing blocks.
+struct WorkloadOptions
+{
+    std::uint32_t seed{1};
+    int statements{100};
+    int nesting{2};
+    int variables{4};
+    // Operators in every generated expression, nested rather than chained
+    int expression_depth{3};
+    // Length of the string literals appended to the string variables
+    int string_length{8};
+
+    // Sets the option named like its command line flag without the dashes, e.g. "nesting".
+    // Returns false if the name or the value is not valid.
+    bool set(const std::string& name, const std::string& value);
+    // Value of a size option by the same name, -1 if there is none
+    [[nodiscard]] int get(const std::string& name) const;
+};
+
+// Emits a valid Lox program for a set of options that runs without a runtime error. The same
+// options always give the same text: only the engine of std::mt19937 is used, its output is
+// fixed by the standard while the std distributions are not.
+class WorkloadGenerator
+{
+public:
+    explicit WorkloadGenerator(const WorkloadOptions& options)
+        : m_options(options), m_random(options.seed)
+    {
+    }
+
+    std::string generate();
+
+private:
+    int next(int bound) { return static_cast<int>(m_random() % static_cast<std::uint32_t>(bound)); }
+
+    void line(int indent, const std::string& text);
+    void declarations(int level, int indent);
+    void block(int level, int indent);
+    void simpleStatement(int level, int indent);
+    std::string expression(int level, int depth);
+    std::string leaf(int level);
+    std::string variable(int level);
+    std::string text();
+
+    WorkloadOptions m_options;
+    std::mt19937 m_random;
+    std::string m_out;
+};
+}  // namespace lox
@@ -0,0 +1,29 @@
+#include <spdlog/spdlog.h>
+
+#include <cstdio>
+#include <string>
+
+#include "workload.hpp"
+
+// Writes a generated program to stdout, e.g.
+//   lox_workload --seed 7 --statements 1000 --nesting 8 > deep.lox
+int main(int argc, char* argv[])
+{
+    lox::WorkloadOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--", 0) != 0 || i + 1 == argc || !options.set(arg.substr(2), argv[i + 1]))
+        {
+            spdlog::warn(
+                "Usage: {} [--seed N] [--statements N] [--nesting N] [--variables N] "
+                "[--expression-depth N] [--string-length N]",
+                argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    auto program = lox::WorkloadGenerator(options).generate();
+    std::fwrite(program.data(), 1, program.size(), stdout);
+    return 0;
+}